@@ -1,9 +1,252 @@
 #include "km_array.h"
 
+#include "km_simd.h"
+
 #define ARRAY_BOUNDS_CHECK(index, size) DEBUG_ASSERTF(0 <= index && (uint32)index < size, \
 "Array bounds check failed: index %" PRIu32 ", size %" PRIu32 "\n", \
 (uint32)index, size)
 
+// Search/compare kernels behind Array<T>::FindFirst, FindLast, Count and Equals.
+// The generic version is a scalar loop using T's operator==. Integer, enum-like and pointer element
+// types are compared bitwise instead, which lets us scan 16 bytes at a time with SSE2 (memchr-style)
+// and use memcmp for Equals. Floats are NOT in this set: 0.0f == -0.0f and NaN != NaN.
+template <typename T> struct IsBitwiseComparable { static const bool VALUE = false; };
+template <typename T> struct IsBitwiseComparable<const T> { static const bool VALUE = IsBitwiseComparable<T>::VALUE; };
+template <typename T> struct IsBitwiseComparable<T*> { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<char>   { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<int8>   { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<uint8>  { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<int16>  { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<uint16> { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<int32>  { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<uint32> { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<int64>  { static const bool VALUE = true; };
+template <> struct IsBitwiseComparable<uint64> { static const bool VALUE = true; };
+
+template <uint32 BYTES> struct KernelLane;
+template <> struct KernelLane<1> { using Type = uint8; };
+template <> struct KernelLane<2> { using Type = uint16; };
+template <> struct KernelLane<4> { using Type = uint32; };
+template <> struct KernelLane<8> { using Type = uint64; };
+
+template <typename T, bool BITWISE = IsBitwiseComparable<T>::VALUE>
+struct ArrayKernels
+{
+    static uint32 FindFirst(const T* data, uint32 size, const T& value, uint32 start)
+    {
+        for (uint32 i = start; i < size; i++) {
+            if (data[i] == value) {
+                return i;
+            }
+        }
+        return size;
+    }
+
+    static uint32 FindLast(const T* data, uint32 size, const T& value)
+    {
+        for (uint32 i = size; i != 0; i--) {
+            if (data[i - 1] == value) {
+                return i - 1;
+            }
+        }
+        return size;
+    }
+
+    static uint32 Count(const T* data, uint32 size, const T& value)
+    {
+        uint32 count = 0;
+        for (uint32 i = 0; i < size; i++) {
+            if (data[i] == value) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    static bool Equals(const T* data1, const T* data2, uint32 size)
+    {
+        for (uint32 i = 0; i < size; i++) {
+            if (!(data1[i] == data2[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#if KM_SIMD_SSE2
+
+template <typename Lane> inline __m128i SimdSet1(Lane value);
+template <> inline __m128i SimdSet1<uint8>(uint8 value)   { return _mm_set1_epi8((char)value); }
+template <> inline __m128i SimdSet1<uint16>(uint16 value) { return _mm_set1_epi16((short)value); }
+template <> inline __m128i SimdSet1<uint32>(uint32 value) { return _mm_set1_epi32((int)value); }
+template <> inline __m128i SimdSet1<uint64>(uint64 value) { return _mm_set1_epi64x((long long)value); }
+
+// Lanes that compare equal are set to all 1s, so the movemask has sizeof(Lane) bits per matching element
+template <typename Lane> inline __m128i SimdCmpEq(__m128i a, __m128i b);
+template <> inline __m128i SimdCmpEq<uint8>(__m128i a, __m128i b)  { return _mm_cmpeq_epi8(a, b); }
+template <> inline __m128i SimdCmpEq<uint16>(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+template <> inline __m128i SimdCmpEq<uint32>(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+template <> inline __m128i SimdCmpEq<uint64>(__m128i a, __m128i b)
+{
+    // No 64-bit compare in SSE2: both 32-bit halves have to match
+    const __m128i cmp32 = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(cmp32, _mm_shuffle_epi32(cmp32, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+template <typename Lane>
+inline uint32 SimdMatchMask(const Lane* data, __m128i needle)
+{
+    return (uint32)_mm_movemask_epi8(SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)data), needle));
+}
+
+template <typename Lane>
+uint32 SimdFindFirst(const Lane* data, uint32 size, Lane value, uint32 start)
+{
+    const uint32 LANES = 16 / sizeof(Lane);
+    const __m128i needle = SimdSet1<Lane>(value);
+
+    uint32 i = start;
+    // 64 bytes per iteration, only build the full mask once something matched
+    while (i < size && size - i >= 4 * LANES) {
+        const __m128i c0 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i)), needle);
+        const __m128i c1 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i + LANES)), needle);
+        const __m128i c2 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i + 2 * LANES)), needle);
+        const __m128i c3 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i + 3 * LANES)), needle);
+        const __m128i any = _mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3));
+        if (_mm_movemask_epi8(any) != 0) {
+            const uint64 mask = (uint64)(uint32)_mm_movemask_epi8(c0)
+                | ((uint64)(uint32)_mm_movemask_epi8(c1) << 16)
+                | ((uint64)(uint32)_mm_movemask_epi8(c2) << 32)
+                | ((uint64)(uint32)_mm_movemask_epi8(c3) << 48);
+            return i + CountTrailingZeros64(mask) / sizeof(Lane);
+        }
+        i += 4 * LANES;
+    }
+    while (i < size && size - i >= LANES) {
+        const uint32 mask = SimdMatchMask<Lane>(data + i, needle);
+        if (mask != 0) {
+            return i + CountTrailingZeros32(mask) / sizeof(Lane);
+        }
+        i += LANES;
+    }
+    for (; i < size; i++) {
+        if (data[i] == value) {
+            return i;
+        }
+    }
+
+    return size;
+}
+
+template <typename Lane>
+uint32 SimdFindLast(const Lane* data, uint32 size, Lane value)
+{
+    const uint32 LANES = 16 / sizeof(Lane);
+    const __m128i needle = SimdSet1<Lane>(value);
+
+    uint32 i = size;
+    while (i >= 4 * LANES) {
+        i -= 4 * LANES;
+        const __m128i c0 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i)), needle);
+        const __m128i c1 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i + LANES)), needle);
+        const __m128i c2 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i + 2 * LANES)), needle);
+        const __m128i c3 = SimdCmpEq<Lane>(_mm_loadu_si128((const __m128i*)(data + i + 3 * LANES)), needle);
+        const __m128i any = _mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3));
+        if (_mm_movemask_epi8(any) != 0) {
+            const uint64 mask = (uint64)(uint32)_mm_movemask_epi8(c0)
+                | ((uint64)(uint32)_mm_movemask_epi8(c1) << 16)
+                | ((uint64)(uint32)_mm_movemask_epi8(c2) << 32)
+                | ((uint64)(uint32)_mm_movemask_epi8(c3) << 48);
+            return i + HighestSetBit64(mask) / sizeof(Lane);
+        }
+    }
+    while (i >= LANES) {
+        i -= LANES;
+        const uint32 mask = SimdMatchMask<Lane>(data + i, needle);
+        if (mask != 0) {
+            return i + HighestSetBit32(mask) / sizeof(Lane);
+        }
+    }
+    while (i != 0) {
+        i--;
+        if (data[i] == value) {
+            return i;
+        }
+    }
+
+    return size;
+}
+
+template <typename Lane>
+uint32 SimdCount(const Lane* data, uint32 size, Lane value)
+{
+    const uint32 LANES = 16 / sizeof(Lane);
+    const __m128i needle = SimdSet1<Lane>(value);
+
+    uint64 matchBits = 0;
+    uint32 i = 0;
+    for (; size - i >= LANES; i += LANES) {
+        matchBits += PopCount32(SimdMatchMask<Lane>(data + i, needle));
+    }
+    uint32 count = (uint32)(matchBits / sizeof(Lane));
+    for (; i < size; i++) {
+        if (data[i] == value) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+#else
+
+template <typename Lane>
+uint32 SimdFindFirst(const Lane* data, uint32 size, Lane value, uint32 start)
+{
+    return ArrayKernels<Lane, false>::FindFirst(data, size, value, start);
+}
+
+template <typename Lane>
+uint32 SimdFindLast(const Lane* data, uint32 size, Lane value)
+{
+    return ArrayKernels<Lane, false>::FindLast(data, size, value);
+}
+
+template <typename Lane>
+uint32 SimdCount(const Lane* data, uint32 size, Lane value)
+{
+    return ArrayKernels<Lane, false>::Count(data, size, value);
+}
+
+#endif
+
+template <typename T>
+struct ArrayKernels<T, true>
+{
+    using Lane = typename KernelLane<sizeof(T)>::Type;
+
+    static uint32 FindFirst(const T* data, uint32 size, const T& value, uint32 start)
+    {
+        return SimdFindFirst<Lane>((const Lane*)data, size, *(const Lane*)&value, start);
+    }
+
+    static uint32 FindLast(const T* data, uint32 size, const T& value)
+    {
+        return SimdFindLast<Lane>((const Lane*)data, size, *(const Lane*)&value);
+    }
+
+    static uint32 Count(const T* data, uint32 size, const T& value)
+    {
+        return SimdCount<Lane>((const Lane*)data, size, *(const Lane*)&value);
+    }
+
+    static bool Equals(const T* data1, const T* data2, uint32 size)
+    {
+        return MemComp(data1, data2, size * sizeof(T)) == 0;
+    }
+};
+
 template <typename T> const Array<T> Array<T>::empty = { .size = 0, .data = nullptr };
 
 template <typename T>
@@ -22,23 +265,34 @@ void Array<T>::Clear()
 template <typename T>
 uint32 Array<T>::FindFirst(const T& value, uint32 start) const
 {
-    for (uint32 i = start; i < size; i++) {
-        if (data[i] == value) {
-            return i;
-        }
-    }
-    return size;
+    return ArrayKernels<T>::FindFirst(data, size, value, start);
 }
 
 template <typename T>
 uint32 Array<T>::FindLast(const T& value) const
 {
-    for (uint32 i = size; i != 0; i--) {
-        if (data[i - 1] == value) {
-            return i - 1;
-        }
+    return ArrayKernels<T>::FindLast(data, size, value);
+}
+
+template <typename T>
+uint32 Array<T>::Count(const T& value) const
+{
+    return ArrayKernels<T>::Count(data, size, value);
+}
+
+template <typename T>
+bool Array<T>::Contains(const T& value) const
+{
+    return FindFirst(value) != size;
+}
+
+template <typename T>
+bool Array<T>::Equals(const Array<const T>& other) const
+{
+    if (size != other.size) {
+        return false;
     }
-    return size;
+    return ArrayKernels<T>::Equals(data, other.data, size);
 }
 
 template <typename T>
@@ -74,9 +328,15 @@ void Array<T>::CopyFrom(const Array<T>& other)
 
 template <typename T>
 void Array<T>::Shuffle()
+{
+    Shuffle(GetThreadRandom());
+}
+
+template <typename T>
+void Array<T>::Shuffle(Random* random)
 {
     for (uint32 i = size; i != 0; i--) {
-        uint32 j = RandUInt32(i);
+        uint32 j = random->UInt32(i);
         T temp = data[i - 1];
         data[i - 1] = data[j];
         data[j] = temp;
@@ -2,6 +2,8 @@
 
 #include "km_defines.h"
 
+struct Random;
+
 template <typename T>
 struct Array
 {
@@ -14,6 +16,9 @@ struct Array
     void Clear();
     uint32 FindFirst(const T& value, uint32 start = 0) const;
     uint32 FindLast(const T& value) const;
+    uint32 Count(const T& value) const;
+    bool Contains(const T& value) const;
+    bool Equals(const Array<const T>& other) const;
 
     Array<T> Slice(uint32 start, uint32 end) const;
     Array<T> SliceTo(uint32 end) const;
@@ -21,6 +26,7 @@ struct Array
 
     void CopyFrom(const Array<T>& other);
     void Shuffle();
+    void Shuffle(Random* random);
 
     inline T& operator[](uint32 index);
     inline const T& operator[](uint32 index) const;
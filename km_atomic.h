@@ -0,0 +1,85 @@
+#pragma once
+
+#include "km_defines.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Minimal atomics for the few lock-free spots in km-common. Loads acquire, stores release.
+
+inline uint32 AtomicFetchIncrement(volatile uint32* value)
+{
+#if defined(_MSC_VER)
+    return (uint32)_InterlockedIncrement((volatile long*)value) - 1;
+#else
+    return __atomic_fetch_add(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Returns true if *value was expected and got replaced by desired
+inline bool AtomicCompareExchange(volatile uint32* value, uint32 expected, uint32 desired)
+{
+#if defined(_MSC_VER)
+    return (uint32)_InterlockedCompareExchange((volatile long*)value, (long)desired, (long)expected)
+        == expected;
+#else
+    return __atomic_compare_exchange_n(value, &expected, desired, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+#endif
+}
+
+inline uint32 AtomicLoad(const volatile uint32* value)
+{
+#if defined(_MSC_VER)
+    // x86/x64 loads are acquire already, only the compiler needs fencing
+    const uint32 result = *value;
+    _ReadWriteBarrier();
+    return result;
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+inline void AtomicStore(volatile uint32* value, uint32 newValue)
+{
+#if defined(_MSC_VER)
+    _ReadWriteBarrier();
+    *value = newValue;
+#else
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+inline void SpinPause()
+{
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// For short critical sections only, waiters burn CPU
+struct SpinLock
+{
+    volatile uint32 locked;
+
+    SpinLock() : locked(0) {}
+
+    void Lock()
+    {
+        while (!AtomicCompareExchange(&locked, 0, 1)) {
+            while (AtomicLoad(&locked) != 0) {
+                SpinPause();
+            }
+        }
+    }
+
+    void Unlock()
+    {
+        AtomicStore(&locked, 0);
+    }
+};
+
+#define SCOPED_SPIN_LOCK(spinLock) (spinLock).Lock(); defer((spinLock).Unlock())
@@ -5,29 +5,87 @@
 static const float32 HASH_TABLE_MAX_SIZE_TO_CAPACITY = 0.7f;
 
 // Very simple string hash ( djb2 hash, source http://www.cse.yorku.ca/~oz/hash.html )
-uint32 KeyHash(const HashKey& key)
+uint32 KeyHash(const Array<const char>& key)
 {
     uint32 hash = 5381;
 
-    for (uint32 i = 0; i < key.s.size; i++) {
-        hash = ((hash << 5) + hash) + key.s[i];
+    for (uint32 i = 0; i < key.size; i++) {
+        hash = ((hash << 5) + hash) + key[i];
     }
 
     return hash;
 }
+uint32 KeyHash(const HashKey& key)
+{
+    return KeyHash(key.s.ToConstArray());
+}
+uint32 KeyHash(uint32 key)
+{
+    return key;
+}
+uint32 KeyHash(uint64 key)
+{
+    return (uint32)(key ^ (key >> 32));
+}
+uint32 KeyHash(int32 key)
+{
+    return (uint32)key;
+}
+uint32 KeyHash(int64 key)
+{
+    return KeyHash((uint64)key);
+}
+
+bool KeyCompare(const Array<const char>& key1, const Array<const char>& key2)
+{
+    return key1.Equals(key2);
+}
 bool KeyCompare(const HashKey& key1, const HashKey& key2)
 {
     if (key1.s.size != key2.s.size) {
         return false;
     }
 
-    for (uint32 i = 0; i < key1.s.size; i++) {
-        if (key1.s[i] != key2.s[i]) {
-            return false;
-        }
-    }
+    return MemComp(key1.s.data, key2.s.data, key1.s.size) == 0;
+}
+bool KeyCompare(const Array<const char>& key1, const HashedKey& key2)
+{
+    return key1.size == key2.size && MemComp(key1.data, key2.data, key1.size) == 0;
+}
+bool KeyCompare(const HashKey& key1, const HashedKey& key2)
+{
+    return KeyCompare(key1.s.ToConstArray(), key2);
+}
+bool KeyCompare(uint32 key1, uint32 key2)
+{
+    return key1 == key2;
+}
+bool KeyCompare(uint64 key1, uint64 key2)
+{
+    return key1 == key2;
+}
+bool KeyCompare(int32 key1, int32 key2)
+{
+    return key1 == key2;
+}
+bool KeyCompare(int64 key1, int64 key2)
+{
+    return key1 == key2;
+}
 
-    return true;
+// Home slot for a hash. Slot counts are powers of 2, so mix the high bits into the low ones first.
+inline uint32 HashSlotHome(uint32 hash, uint32 capacity)
+{
+    hash ^= hash >> 16;
+    hash *= 0x7feb352d;
+    hash ^= hash >> 15;
+    return hash & (capacity - 1);
+}
+
+// Pairs array size for a slot capacity, the table grows when this is reached
+inline uint32 HashTableMaxPairs(uint32 capacity)
+{
+    return (uint32)((float32)capacity * HASH_TABLE_MAX_SIZE_TO_CAPACITY);
 }
 
 // TODO dumb wrappers until I figure out a better way to do this at compile time
@@ -73,7 +131,7 @@ DynamicArray<T, Allocator>::DynamicArray(Allocator* allocator, uint32 capacity)
 
 template <typename T, typename Allocator>
 DynamicArray<T, Allocator>::DynamicArray(const Array<T>& array, Allocator* allocator)
-: DynamicArray(array.size < DYNAMIC_ARRAY_START_CAPACITY ? DYNAMIC_ARRAY_START_CAPACITY : array.size, allocator)
+: DynamicArray(allocator, array.size < DYNAMIC_ARRAY_START_CAPACITY ? DYNAMIC_ARRAY_START_CAPACITY : array.size)
 {
     FromArray(array);
 }
@@ -157,14 +215,9 @@ void DynamicArray<T, Allocator>::RemoveLast()
 }
 
 template <typename T, typename Allocator>
-uint32 DynamicArray<T, Allocator>::IndexOf(const T& value)
+uint32 DynamicArray<T, Allocator>::IndexOf(const T& value) const
 {
-    for (uint32 i = 0; i < size; i++) {
-        if (data[i] == value) {
-            return i;
-        }
-    }
-    return size;
+    return ToArray().FindFirst(value);
 }
 
 template <typename T, typename Allocator>
@@ -262,160 +315,1267 @@ bool HashKey::WriteString(const char* str)
     return WriteString(ToString(str));
 }
 
-template <typename V, typename Allocator>
-HashTable<V, Allocator>::HashTable(Allocator* allocator, uint32 capacity)
+template <typename V, typename Allocator, typename K>
+HashTable<V, Allocator, K>::HashTable(Allocator* allocator, uint32 capacity)
 {
     Initialize(allocator, capacity);
 }
 
-template <typename V, typename Allocator>
-HashTable<V, Allocator>::~HashTable()
+template <typename V, typename Allocator, typename K>
+HashTable<V, Allocator, K>::~HashTable()
 {
-    for (uint32 i = 0; i < capacity; i++) {
-        pairs[i].~KeyValuePair<V>();
+    if (pairs == nullptr) {
+        return;
+    }
+    for (uint32 i = 0; i < size; i++) {
+        pairs[i].~KeyValuePair<V, K>();
     }
-    allocator->Free(pairs);
+    FreeOrUseDefautIfNull(allocator, pairs);
+    FreeOrUseDefautIfNull(allocator, slots);
 }
 
-template <typename V, typename Allocator>
-V* HashTable<V, Allocator>::Add(const HashKey& key)
+template <typename V, typename Allocator, typename K>
+V* HashTable<V, Allocator, K>::Add(const K& key)
 {
-    DEBUG_ASSERT(GetPair(key) == nullptr);
+    const uint32 hash = KeyHash(key);
+    DEBUG_ASSERT(FindSlot(key, hash) == capacity);
 
-    if (size >= (uint32)((float32)capacity * HASH_TABLE_MAX_SIZE_TO_CAPACITY)) {
-        uint32 newCapacity = NextPrime(capacity * 2);
-        pairs = (KeyValuePair<V>*)allocator->ReAllocate(pairs, sizeof(KeyValuePair<V>) * newCapacity);
-        if (pairs == nullptr) {
-            DEBUG_PANIC("not enough memory for HashTable resize (pairs allocation)\n");
-        }
-
-        for (uint32 i = 0; i < capacity; i++) {
-            // Don't placement new here, probably? Because it'll reset everything...
-            // new (&pairs[i]) KeyValuePair<V>();
-        }
-        KeyValuePair<V>* oldPairs = (KeyValuePair<V>*)allocator->Allocate(sizeof(KeyValuePair<V>) * capacity);
-        if (oldPairs == nullptr) {
-            DEBUG_PANIC("not enough memory for HashTable resize (oldPairs allocation)\n");
+    if (size >= HashTableMaxPairs(capacity)) {
+        if (!UpdateCapacity(capacity * 2)) {
+            DEBUG_PANIC("not enough memory for HashTable resize\n");
+            return nullptr;
         }
-        defer(allocator->Free(oldPairs));
-        MemCopy(oldPairs, pairs, sizeof(KeyValuePair<V>) * capacity);
-        DEBUG_PANIC("TODO can't resize+rehash yet\n");
-        // capacity = newCapacity;
     }
 
-    KeyValuePair<V>* pair = GetFreeSlot(key);
-    DEBUG_ASSERT(pair != nullptr);
+    const uint32 pairIndex = size++;
+    pairs[pairIndex].key = key;
+    InsertSlot(hash, pairIndex);
 
-    pair->key = key;
-    size++;
-
-    return &(pair->value);
+    return &pairs[pairIndex].value;
 }
 
-template <typename V, typename Allocator>
-void HashTable<V, Allocator>::Add(const HashKey& key, const V& value)
+template <typename V, typename Allocator, typename K>
+void HashTable<V, Allocator, K>::Add(const K& key, const V& value)
 {
     *(Add(key)) = value;
 }
 
-template <typename V, typename Allocator>
-V* HashTable<V, Allocator>::GetValue(const HashKey& key)
+template <typename V, typename Allocator, typename K>
+V* HashTable<V, Allocator, K>::GetValue(const K& key)
 {
-    KeyValuePair<V>* pair = GetPair(key);
-    if (pair == nullptr) {
+    const uint32 slotIndex = FindSlot(key, KeyHash(key));
+    if (slotIndex == capacity) {
         return nullptr;
     }
 
-    return &pair->value;
+    return &pairs[slots[slotIndex].index - 1].value;
 }
 
-template <typename V, typename Allocator>
-const V* HashTable<V, Allocator>::GetValue(const HashKey& key) const
+template <typename V, typename Allocator, typename K>
+const V* HashTable<V, Allocator, K>::GetValue(const K& key) const
+{
+    return const_cast<HashTable<V, Allocator, K>*>(this)->GetValue(key);
+}
+
+template <typename V, typename Allocator, typename K>
+V* HashTable<V, Allocator, K>::GetValue(const HashedKey& key)
 {
-    const KeyValuePair<V>* pair = GetPair(key);
-    if (pair == nullptr) {
+    const uint32 slotIndex = FindSlot(key, key.hash);
+    if (slotIndex == capacity) {
         return nullptr;
     }
 
-    return &pair->value;
+    return &pairs[slots[slotIndex].index - 1].value;
 }
 
-template <typename V, typename Allocator>
-void HashTable<V, Allocator>::Clear()
+template <typename V, typename Allocator, typename K>
+const V* HashTable<V, Allocator, K>::GetValue(const HashedKey& key) const
+{
+    return const_cast<HashTable<V, Allocator, K>*>(this)->GetValue(key);
+}
+
+template <typename V, typename Allocator, typename K>
+bool HashTable<V, Allocator, K>::Remove(const K& key)
 {
-    for (uint32 i = 0; i < capacity; i++) {
-        pairs[i].key.s.size = 0;
+    const uint32 slotIndex = FindSlot(key, KeyHash(key));
+    if (slotIndex == capacity) {
+        return false;
+    }
+
+    const uint32 pairIndex = slots[slotIndex].index - 1;
+    RemoveSlot(slotIndex);
+
+    // Keep pairs dense: move the last pair into the hole and repoint its slot
+    const uint32 lastIndex = size - 1;
+    if (pairIndex != lastIndex) {
+        const uint32 lastSlotIndex = FindSlot(pairs[lastIndex].key, KeyHash(pairs[lastIndex].key));
+        DEBUG_ASSERT(lastSlotIndex != capacity);
+        slots[lastSlotIndex].index = pairIndex + 1;
+        MemCopy(&pairs[pairIndex], &pairs[lastIndex], sizeof(KeyValuePair<V, K>));
     }
+
+    size--;
+    return true;
 }
 
-template <typename V, typename Allocator>
-void HashTable<V, Allocator>::Initialize(Allocator* allocator, uint32 capacity)
+template <typename V, typename Allocator, typename K>
+KeyValuePair<V, K>* HashTable<V, Allocator, K>::begin()
+{
+    return pairs;
+}
+
+template <typename V, typename Allocator, typename K>
+KeyValuePair<V, K>* HashTable<V, Allocator, K>::end()
+{
+    return pairs + size;
+}
+
+template <typename V, typename Allocator, typename K>
+const KeyValuePair<V, K>* HashTable<V, Allocator, K>::begin() const
+{
+    return pairs;
+}
+
+template <typename V, typename Allocator, typename K>
+const KeyValuePair<V, K>* HashTable<V, Allocator, K>::end() const
+{
+    return pairs + size;
+}
+
+template <typename V, typename Allocator, typename K>
+void HashTable<V, Allocator, K>::Clear()
 {
+    MemSet(slots, 0, capacity * sizeof(HashSlot));
     size = 0;
-    uint32 sizeBytes = sizeof(KeyValuePair<V>) * capacity;
-    pairs = (KeyValuePair<V>*)allocator->Allocate(sizeBytes);
-    if (pairs == nullptr) {
-        DEBUG_PANIC("ERROR: not enough memory!\n");
-    }
+}
 
-    for (uint32 i = 0; i < capacity; i++) {
-        pairs[i].key.s.size = 0;
-        // NOTE nope. not doing this anymore
-        // new (&pairs[i]) KeyValuePair<V>();
+template <typename V, typename Allocator, typename K>
+void HashTable<V, Allocator, K>::Initialize(Allocator* allocator, uint32 capacity)
+{
+    capacity = RoundUpToAnyPowerOfTwo(MaxUInt32(capacity, 8));
+
+    size = 0;
+    pairs = (KeyValuePair<V, K>*)AllocateOrUseDefaultIfNull(allocator,
+                                                            HashTableMaxPairs(capacity) * sizeof(KeyValuePair<V, K>));
+    slots = (HashSlot*)AllocateOrUseDefaultIfNull(allocator, capacity * sizeof(HashSlot));
+    if (pairs == nullptr || slots == nullptr) {
+        DEBUG_PANIC("ERROR: not enough memory!\n");
     }
+    // NOTE nope. not constructing pairs here, same as DynamicArray
+    MemSet(slots, 0, capacity * sizeof(HashSlot));
 
     this->capacity = capacity;
     this->allocator = allocator;
 }
 
-template <typename V, typename Allocator>
-void HashTable<V, Allocator>::Free()
+template <typename V, typename Allocator, typename K>
+void HashTable<V, Allocator, K>::Free()
 {
-    allocator->Free(pairs);
+    FreeOrUseDefautIfNull(allocator, pairs);
+    FreeOrUseDefautIfNull(allocator, slots);
 
+    pairs = nullptr;
+    slots = nullptr;
     capacity = 0;
     size = 0;
 }
 
-template <typename V, typename Allocator>
-HashTable<V, Allocator>& HashTable<V, Allocator>::operator=(const HashTable<V, Allocator>& other)
+template <typename V, typename Allocator, typename K>
+HashTable<V, Allocator, K>& HashTable<V, Allocator, K>::operator=(const HashTable<V, Allocator, K>& other)
 {
-    DEBUG_ASSERT(capacity == other.capacity); // TODO no rehashing, so we do same-capacity only
+    if (this == &other) {
+        return *this;
+    }
+
+    // Empty first, so a resize down doesn't have to keep (or rehash) the old pairs
+    for (uint32 i = 0; i < size; i++) {
+        pairs[i].~KeyValuePair<V, K>();
+    }
+    size = 0;
+    if (capacity != other.capacity) {
+        if (!UpdateCapacity(other.capacity)) {
+            DEBUG_PANIC("not enough memory for HashTable copy\n");
+            MemSet(slots, 0, capacity * sizeof(HashSlot));
+            return *this;
+        }
+    }
+
+    // Pairs past size are unconstructed, values are assigned over freshly constructed ones
     size = other.size;
-    for (uint32 i = 0; i < capacity; i++) {
+    for (uint32 i = 0; i < size; i++) {
+        new (&pairs[i]) KeyValuePair<V, K>();
         pairs[i] = other.pairs[i];
     }
+    MemCopy(slots, other.slots, capacity * sizeof(HashSlot));
     return *this;
 }
 
-template <typename V, typename Allocator>
-KeyValuePair<V>* HashTable<V, Allocator>::GetPair(const HashKey& key) const
+// Slot holding the given key, or capacity if the key isn't in the table
+template <typename V, typename Allocator, typename K>
+template <typename Q>
+uint32 HashTable<V, Allocator, K>::FindSlot(const Q& key, uint32 hash) const
 {
-    uint32 hashInd = KeyHash(key) % capacity;
-    for (uint32 i = 0; i < capacity; i++) {
-        KeyValuePair<V>* pair = pairs + hashInd + i;
-        if (KeyCompare(pair->key, key)) {
-            return pair;
+    const uint32 mask = capacity - 1;
+    uint32 slotIndex = HashSlotHome(hash, capacity);
+    while (true) {
+        const HashSlot& slot = slots[slotIndex];
+        if (slot.index == 0) {
+            return capacity;
         }
-        if (pair->key.s.size == 0) {
-            return nullptr;
+        if (slot.hash == hash && KeyCompare(pairs[slot.index - 1].key, key)) {
+            return slotIndex;
         }
+        slotIndex = (slotIndex + 1) & mask;
+    }
+}
+
+template <typename V, typename Allocator, typename K>
+void HashTable<V, Allocator, K>::InsertSlot(uint32 hash, uint32 pairIndex)
+{
+    const uint32 mask = capacity - 1;
+    uint32 slotIndex = HashSlotHome(hash, capacity);
+    while (slots[slotIndex].index != 0) {
+        slotIndex = (slotIndex + 1) & mask;
     }
 
-    return nullptr;
+    slots[slotIndex].hash = hash;
+    slots[slotIndex].index = pairIndex + 1;
 }
 
-template <typename V, typename Allocator>
-KeyValuePair<V>* HashTable<V, Allocator>::GetFreeSlot(const HashKey& key)
+template <typename V, typename Allocator, typename K>
+void HashTable<V, Allocator, K>::RemoveSlot(uint32 slotIndex)
+{
+    // Backward-shift deletion: pull later slots of the probe run into the hole when their home slot
+    // allows it, so lookups never stop early at an empty slot and no tombstones are needed
+    const uint32 mask = capacity - 1;
+    uint32 hole = slotIndex;
+    uint32 i = slotIndex;
+    while (true) {
+        i = (i + 1) & mask;
+        if (slots[i].index == 0) {
+            break;
+        }
+
+        const uint32 home = HashSlotHome(slots[i].hash, capacity);
+        const bool homeInRun = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!homeInRun) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+
+    slots[hole].index = 0;
+}
+
+template <typename V, typename Allocator, typename K>
+bool HashTable<V, Allocator, K>::UpdateCapacity(uint32 newCapacity)
+{
+    DEBUG_ASSERT(IsPowerOfTwo(newCapacity));
+    DEBUG_ASSERT(HashTableMaxPairs(newCapacity) >= size);
+
+    // ReAllocate only, no Free, so this stays well-behaved with LinearAllocator
+    void* newPairs = ReAllocateOrUseDefaultIfNull(allocator, pairs,
+                                                  HashTableMaxPairs(newCapacity) * sizeof(KeyValuePair<V, K>));
+    if (newPairs == nullptr) {
+        return false;
+    }
+    pairs = (KeyValuePair<V, K>*)newPairs;
+
+    void* newSlots = ReAllocateOrUseDefaultIfNull(allocator, slots, newCapacity * sizeof(HashSlot));
+    if (newSlots == nullptr) {
+        return false;
+    }
+    slots = (HashSlot*)newSlots;
+
+    // Slot positions depend on capacity, rebuild them from the pairs
+    capacity = newCapacity;
+    MemSet(slots, 0, capacity * sizeof(HashSlot));
+    for (uint32 i = 0; i < size; i++) {
+        InsertSlot(KeyHash(pairs[i].key), i);
+    }
+
+    return true;
+}
+
+template <typename K>
+const K& HashSetIterator<K>::operator*() const
+{
+    return pair->key;
+}
+
+template <typename K>
+HashSetIterator<K>& HashSetIterator<K>::operator++()
+{
+    pair++;
+    return *this;
+}
+
+template <typename K>
+bool HashSetIterator<K>::operator==(const HashSetIterator<K>& other) const
+{
+    return pair == other.pair;
+}
+
+template <typename K>
+bool HashSetIterator<K>::operator!=(const HashSetIterator<K>& other) const
+{
+    return pair != other.pair;
+}
+
+template <typename K, typename Allocator>
+HashSet<K, Allocator>::HashSet(Allocator* allocator, uint32 capacity)
+: table(allocator, capacity)
+{
+}
+
+template <typename K, typename Allocator>
+bool HashSet<K, Allocator>::Add(const K& key)
+{
+    if (table.GetValue(key) != nullptr) {
+        return false;
+    }
+
+    table.Add(key);
+    return true;
+}
+
+template <typename K, typename Allocator>
+bool HashSet<K, Allocator>::Contains(const K& key) const
+{
+    return table.GetValue(key) != nullptr;
+}
+
+template <typename K, typename Allocator>
+bool HashSet<K, Allocator>::Remove(const K& key)
+{
+    return table.Remove(key);
+}
+
+template <typename K, typename Allocator>
+HashSetIterator<K> HashSet<K, Allocator>::begin() const
+{
+    return { .pair = table.begin() };
+}
+
+template <typename K, typename Allocator>
+HashSetIterator<K> HashSet<K, Allocator>::end() const
+{
+    return { .pair = table.end() };
+}
+
+template <typename K, typename Allocator>
+void HashSet<K, Allocator>::Clear()
+{
+    table.Clear();
+}
+
+template <typename K, typename Allocator>
+void HashSet<K, Allocator>::Initialize(Allocator* allocator, uint32 capacity)
+{
+    table.Initialize(allocator, capacity);
+}
+
+template <typename K, typename Allocator>
+void HashSet<K, Allocator>::Free()
+{
+    table.Free();
+}
+
+// Number of keys < key, i.e. the index of the first key >= key
+template <typename K>
+uint32 LowerBoundIndex(const K* keys, uint32 size, const K& key)
+{
+    uint32 low = 0;
+    uint32 high = size;
+    while (low < high) {
+        const uint32 mid = low + (high - low) / 2;
+        if (keys[mid] < key) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Number of keys <= key, i.e. the index of the first key > key
+template <typename K>
+uint32 UpperBoundIndex(const K* keys, uint32 size, const K& key)
+{
+    uint32 low = 0;
+    uint32 high = size;
+    while (low < high) {
+        const uint32 mid = low + (high - low) / 2;
+        if (key < keys[mid]) {
+            high = mid;
+        }
+        else {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+template <typename K, typename V, uint32 N>
+internal void BTreeLeafInsert(BTreeLeaf<K, V, N>* leaf, uint32 index, const K& key)
+{
+    DEBUG_ASSERT(leaf->size < N);
+    MemMove(leaf->keys + index + 1, leaf->keys + index, (leaf->size - index) * sizeof(K));
+    MemMove(leaf->values + index + 1, leaf->values + index, (leaf->size - index) * sizeof(V));
+    leaf->keys[index] = key;
+    leaf->size++;
+}
+
+template <typename K, typename V, uint32 N>
+internal void BTreeLeafRemove(BTreeLeaf<K, V, N>* leaf, uint32 index)
+{
+    MemMove(leaf->keys + index, leaf->keys + index + 1, (leaf->size - index - 1) * sizeof(K));
+    MemMove(leaf->values + index, leaf->values + index + 1, (leaf->size - index - 1) * sizeof(V));
+    leaf->size--;
+}
+
+// Appends all of src's items to dst and unlinks src
+template <typename K, typename V, uint32 N>
+internal void BTreeLeafMerge(BTreeLeaf<K, V, N>* dst, BTreeLeaf<K, V, N>* src)
+{
+    DEBUG_ASSERT(dst->size + src->size <= N);
+    MemCopy(dst->keys + dst->size, src->keys, src->size * sizeof(K));
+    MemCopy(dst->values + dst->size, src->values, src->size * sizeof(V));
+    dst->size += src->size;
+
+    dst->next = src->next;
+    if (src->next != nullptr) {
+        src->next->prev = dst;
+    }
+}
+
+// Inserts key and the child to its right, next to the existing child at childIndex
+template <typename K, uint32 N>
+internal void BTreeInternalInsert(BTreeInternal<K, N>* internalNode, uint32 childIndex, const K& key, void* child)
+{
+    DEBUG_ASSERT(internalNode->size < N);
+    MemMove(internalNode->keys + childIndex + 1, internalNode->keys + childIndex,
+            (internalNode->size - childIndex) * sizeof(K));
+    MemMove(internalNode->children + childIndex + 2, internalNode->children + childIndex + 1,
+            (internalNode->size - childIndex) * sizeof(void*));
+    internalNode->keys[childIndex] = key;
+    internalNode->children[childIndex + 1] = child;
+    internalNode->size++;
+}
+
+// Removes the key at keyIndex and the child to its right
+template <typename K, uint32 N>
+internal void BTreeInternalRemove(BTreeInternal<K, N>* internalNode, uint32 keyIndex)
+{
+    MemMove(internalNode->keys + keyIndex, internalNode->keys + keyIndex + 1,
+            (internalNode->size - keyIndex - 1) * sizeof(K));
+    MemMove(internalNode->children + keyIndex + 1, internalNode->children + keyIndex + 2,
+            (internalNode->size - keyIndex - 1) * sizeof(void*));
+    internalNode->size--;
+}
+
+// Appends separator and all of src's keys and children to dst
+template <typename K, uint32 N>
+internal void BTreeInternalMerge(BTreeInternal<K, N>* dst, const K& separator, BTreeInternal<K, N>* src)
+{
+    DEBUG_ASSERT(dst->size + 1 + src->size <= N);
+    dst->keys[dst->size] = separator;
+    MemCopy(dst->keys + dst->size + 1, src->keys, src->size * sizeof(K));
+    MemCopy(dst->children + dst->size + 1, src->children, (src->size + 1) * sizeof(void*));
+    dst->size += src->size + 1;
+}
+
+template <typename K, typename V, uint32 N>
+KeyValueRef<K, V> BTreeIterator<K, V, N>::operator*() const
+{
+    DEBUG_ASSERT(leaf != nullptr);
+    return { leaf->keys[index], leaf->values[index] };
+}
+
+template <typename K, typename V, uint32 N>
+BTreeIterator<K, V, N>& BTreeIterator<K, V, N>::operator++()
+{
+    DEBUG_ASSERT(leaf != nullptr);
+    index++;
+    if (index >= leaf->size) {
+        leaf = leaf->next;
+        index = 0;
+    }
+    return *this;
+}
+
+template <typename K, typename V, uint32 N>
+bool BTreeIterator<K, V, N>::operator==(const BTreeIterator<K, V, N>& other) const
+{
+    return leaf == other.leaf && index == other.index;
+}
+
+template <typename K, typename V, uint32 N>
+bool BTreeIterator<K, V, N>::operator!=(const BTreeIterator<K, V, N>& other) const
+{
+    return !(*this == other);
+}
+
+template <typename K, typename V, typename Allocator>
+BTreeMap<K, V, Allocator>::BTreeMap(Allocator* allocator)
+{
+    Initialize(allocator);
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::Add(const K& key, const V& value)
+{
+    *(Add(key)) = value;
+}
+
+template <typename K, typename V, typename Allocator>
+V* BTreeMap<K, V, Allocator>::Add(const K& key)
 {
-    uint32 hashInd = KeyHash(key) % capacity;
-    for (uint32 i = 0; i < capacity; i++) {
-        KeyValuePair<V>* pair = pairs + hashInd + i;
-        if (pair->key.s.size == 0) {
-            return pair;
+    if (root == nullptr) {
+        Leaf* leaf = NewLeaf();
+        leaf->size = 0;
+        leaf->prev = nullptr;
+        leaf->next = nullptr;
+        root = leaf;
+        first = leaf;
+        depth = 0;
+    }
+
+    Internal* path[BTREE_MAX_DEPTH];
+    uint32 pathIndices[BTREE_MAX_DEPTH];
+    void* node = root;
+    for (uint32 level = 0; level < depth; level++) {
+        Internal* internalNode = (Internal*)node;
+        path[level] = internalNode;
+        pathIndices[level] = UpperBoundIndex(internalNode->keys, internalNode->size, key);
+        node = internalNode->children[pathIndices[level]];
+    }
+
+    Leaf* leaf = (Leaf*)node;
+    const uint32 index = LowerBoundIndex(leaf->keys, leaf->size, key);
+    DEBUG_ASSERT(index == leaf->size || key < leaf->keys[index]);
+    size++;
+
+    if (leaf->size < NODE_KEYS) {
+        BTreeLeafInsert(leaf, index, key);
+        return &leaf->values[index];
+    }
+
+    // Split the full leaf. Appending past the last item keeps the left leaf full, so increasing keys
+    // (the common case for timelines and IDs) pack leaves completely instead of half-full.
+    const uint32 splitIndex = (index == NODE_KEYS && leaf->next == nullptr) ? NODE_KEYS : NODE_KEYS / 2;
+    Leaf* rightLeaf = NewLeaf();
+    rightLeaf->size = NODE_KEYS - splitIndex;
+    MemCopy(rightLeaf->keys, leaf->keys + splitIndex, rightLeaf->size * sizeof(K));
+    MemCopy(rightLeaf->values, leaf->values + splitIndex, rightLeaf->size * sizeof(V));
+    leaf->size = splitIndex;
+
+    rightLeaf->prev = leaf;
+    rightLeaf->next = leaf->next;
+    if (leaf->next != nullptr) {
+        leaf->next->prev = rightLeaf;
+    }
+    leaf->next = rightLeaf;
+
+    V* value;
+    if (index < splitIndex) {
+        BTreeLeafInsert(leaf, index, key);
+        value = &leaf->values[index];
+    }
+    else {
+        BTreeLeafInsert(rightLeaf, index - splitIndex, key);
+        value = &rightLeaf->values[index - splitIndex];
+    }
+
+    // Propagate splits up the path
+    K separator = rightLeaf->keys[0];
+    void* newChild = rightLeaf;
+    uint32 level = depth;
+    while (level > 0) {
+        level--;
+        Internal* parent = path[level];
+        const uint32 childIndex = pathIndices[level];
+        if (parent->size < NODE_KEYS) {
+            BTreeInternalInsert(parent, childIndex, separator, newChild);
+            return value;
+        }
+
+        const uint32 splitKeyIndex = childIndex == NODE_KEYS ? NODE_KEYS - 1 : NODE_KEYS / 2;
+        const K splitKey = parent->keys[splitKeyIndex];
+        Internal* rightInternal = NewInternal();
+        rightInternal->size = NODE_KEYS - splitKeyIndex - 1;
+        MemCopy(rightInternal->keys, parent->keys + splitKeyIndex + 1, rightInternal->size * sizeof(K));
+        MemCopy(rightInternal->children, parent->children + splitKeyIndex + 1,
+                (rightInternal->size + 1) * sizeof(void*));
+        parent->size = splitKeyIndex;
+
+        if (childIndex <= splitKeyIndex) {
+            BTreeInternalInsert(parent, childIndex, separator, newChild);
         }
+        else {
+            BTreeInternalInsert(rightInternal, childIndex - splitKeyIndex - 1, separator, newChild);
+        }
+
+        separator = splitKey;
+        newChild = rightInternal;
+    }
+
+    // Root was split, grow the tree by one level
+    DEBUG_ASSERT(depth + 1 < BTREE_MAX_DEPTH);
+    Internal* newRoot = NewInternal();
+    newRoot->size = 1;
+    newRoot->keys[0] = separator;
+    newRoot->children[0] = root;
+    newRoot->children[1] = newChild;
+    root = newRoot;
+    depth++;
+
+    return value;
+}
+
+template <typename K, typename V, typename Allocator>
+V* BTreeMap<K, V, Allocator>::GetValue(const K& key)
+{
+    Leaf* leaf = FindLeaf(key);
+    if (leaf == nullptr) {
+        return nullptr;
     }
 
-    return nullptr;
+    const uint32 index = LowerBoundIndex(leaf->keys, leaf->size, key);
+    if (index == leaf->size || key < leaf->keys[index]) {
+        return nullptr;
+    }
+    return &leaf->values[index];
 }
 
+template <typename K, typename V, typename Allocator>
+const V* BTreeMap<K, V, Allocator>::GetValue(const K& key) const
+{
+    return const_cast<BTreeMap<K, V, Allocator>*>(this)->GetValue(key);
+}
+
+template <typename K, typename V, typename Allocator>
+bool BTreeMap<K, V, Allocator>::Remove(const K& key)
+{
+    if (root == nullptr) {
+        return false;
+    }
+
+    Internal* path[BTREE_MAX_DEPTH];
+    uint32 pathIndices[BTREE_MAX_DEPTH];
+    void* node = root;
+    for (uint32 level = 0; level < depth; level++) {
+        Internal* internalNode = (Internal*)node;
+        path[level] = internalNode;
+        pathIndices[level] = UpperBoundIndex(internalNode->keys, internalNode->size, key);
+        node = internalNode->children[pathIndices[level]];
+    }
+
+    Leaf* leaf = (Leaf*)node;
+    const uint32 index = LowerBoundIndex(leaf->keys, leaf->size, key);
+    if (index == leaf->size || key < leaf->keys[index]) {
+        return false;
+    }
+
+    // NOTE separator keys equal to the removed key are left alone, they still split the key space correctly
+    BTreeLeafRemove(leaf, index);
+    size--;
+    if (depth == 0 || leaf->size >= NODE_MIN_KEYS) {
+        return true;
+    }
+
+    RebalanceLeaf(leaf, path[depth - 1], pathIndices[depth - 1]);
+    for (uint32 level = depth - 1; level > 0 && path[level]->size < NODE_MIN_KEYS; level--) {
+        RebalanceInternal(path[level], path[level - 1], pathIndices[level - 1]);
+    }
+
+    Internal* rootInternal = (Internal*)root;
+    if (rootInternal->size == 0) {
+        root = rootInternal->children[0];
+        depth--;
+        RecycleInternal(rootInternal);
+    }
+
+    return true;
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Iterator BTreeMap<K, V, Allocator>::LowerBound(const K& key) const
+{
+    Leaf* leaf = FindLeaf(key);
+    if (leaf == nullptr) {
+        return end();
+    }
+    return MakeIterator(leaf, LowerBoundIndex(leaf->keys, leaf->size, key));
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Iterator BTreeMap<K, V, Allocator>::UpperBound(const K& key) const
+{
+    Leaf* leaf = FindLeaf(key);
+    if (leaf == nullptr) {
+        return end();
+    }
+    return MakeIterator(leaf, UpperBoundIndex(leaf->keys, leaf->size, key));
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Iterator BTreeMap<K, V, Allocator>::begin() const
+{
+    return MakeIterator(root == nullptr ? nullptr : first, 0);
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Iterator BTreeMap<K, V, Allocator>::end() const
+{
+    return { .leaf = nullptr, .index = 0 };
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::Clear()
+{
+    if (root != nullptr) {
+        RecycleSubtree(root, 0);
+    }
+
+    size = 0;
+    depth = 0;
+    root = nullptr;
+    first = nullptr;
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::Initialize(Allocator* allocator)
+{
+    size = 0;
+    depth = 0;
+    root = nullptr;
+    first = nullptr;
+    freeLeaves = nullptr;
+    freeInternals = nullptr;
+    this->allocator = allocator;
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::Free()
+{
+    if (root != nullptr) {
+        FreeSubtree(root, 0);
+    }
+    while (freeLeaves != nullptr) {
+        void* next = *(void**)freeLeaves;
+        FreeOrUseDefautIfNull(allocator, freeLeaves);
+        freeLeaves = next;
+    }
+    while (freeInternals != nullptr) {
+        void* next = *(void**)freeInternals;
+        FreeOrUseDefautIfNull(allocator, freeInternals);
+        freeInternals = next;
+    }
+
+    size = 0;
+    depth = 0;
+    root = nullptr;
+    first = nullptr;
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Leaf* BTreeMap<K, V, Allocator>::FindLeaf(const K& key) const
+{
+    if (root == nullptr) {
+        return nullptr;
+    }
+
+    void* node = root;
+    for (uint32 level = 0; level < depth; level++) {
+        const Internal* internalNode = (const Internal*)node;
+        node = internalNode->children[UpperBoundIndex(internalNode->keys, internalNode->size, key)];
+    }
+    return (Leaf*)node;
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Iterator BTreeMap<K, V, Allocator>::MakeIterator(Leaf* leaf, uint32 index) const
+{
+    // Only the root leaf can be empty, and an index past the end of a leaf means the start of the next one
+    while (leaf != nullptr && index >= leaf->size) {
+        leaf = leaf->next;
+        index = 0;
+    }
+    return { .leaf = leaf, .index = index };
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Leaf* BTreeMap<K, V, Allocator>::NewLeaf()
+{
+    if (freeLeaves != nullptr) {
+        Leaf* leaf = (Leaf*)freeLeaves;
+        freeLeaves = *(void**)freeLeaves;
+        return leaf;
+    }
+
+    Leaf* leaf = (Leaf*)AllocateOrUseDefaultIfNull(allocator, sizeof(Leaf));
+    if (leaf == nullptr) {
+        DEBUG_PANIC("not enough memory for BTreeMap leaf\n");
+    }
+    return leaf;
+}
+
+template <typename K, typename V, typename Allocator>
+typename BTreeMap<K, V, Allocator>::Internal* BTreeMap<K, V, Allocator>::NewInternal()
+{
+    if (freeInternals != nullptr) {
+        Internal* internalNode = (Internal*)freeInternals;
+        freeInternals = *(void**)freeInternals;
+        return internalNode;
+    }
+
+    Internal* internalNode = (Internal*)AllocateOrUseDefaultIfNull(allocator, sizeof(Internal));
+    if (internalNode == nullptr) {
+        DEBUG_PANIC("not enough memory for BTreeMap internal node\n");
+    }
+    return internalNode;
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::RecycleLeaf(Leaf* leaf)
+{
+    *(void**)leaf = freeLeaves;
+    freeLeaves = leaf;
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::RecycleInternal(Internal* internalNode)
+{
+    *(void**)internalNode = freeInternals;
+    freeInternals = internalNode;
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::RecycleSubtree(void* node, uint32 level)
+{
+    if (level == depth) {
+        RecycleLeaf((Leaf*)node);
+        return;
+    }
+
+    Internal* internalNode = (Internal*)node;
+    for (uint32 i = 0; i <= internalNode->size; i++) {
+        RecycleSubtree(internalNode->children[i], level + 1);
+    }
+    RecycleInternal(internalNode);
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::FreeSubtree(void* node, uint32 level)
+{
+    if (level < depth) {
+        Internal* internalNode = (Internal*)node;
+        for (uint32 i = 0; i <= internalNode->size; i++) {
+            FreeSubtree(internalNode->children[i], level + 1);
+        }
+    }
+    FreeOrUseDefautIfNull(allocator, node);
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::RebalanceLeaf(Leaf* leaf, Internal* parent, uint32 childIndex)
+{
+    Leaf* leftLeaf = childIndex > 0 ? (Leaf*)parent->children[childIndex - 1] : nullptr;
+    Leaf* rightLeaf = childIndex < parent->size ? (Leaf*)parent->children[childIndex + 1] : nullptr;
+
+    if (leftLeaf != nullptr && leftLeaf->size > NODE_MIN_KEYS) {
+        const uint32 last = leftLeaf->size - 1;
+        BTreeLeafInsert(leaf, 0, leftLeaf->keys[last]);
+        leaf->values[0] = leftLeaf->values[last];
+        leftLeaf->size--;
+        parent->keys[childIndex - 1] = leaf->keys[0];
+    }
+    else if (rightLeaf != nullptr && rightLeaf->size > NODE_MIN_KEYS) {
+        BTreeLeafInsert(leaf, leaf->size, rightLeaf->keys[0]);
+        leaf->values[leaf->size - 1] = rightLeaf->values[0];
+        BTreeLeafRemove(rightLeaf, 0);
+        parent->keys[childIndex] = rightLeaf->keys[0];
+    }
+    else if (leftLeaf != nullptr) {
+        BTreeLeafMerge(leftLeaf, leaf);
+        RecycleLeaf(leaf);
+        BTreeInternalRemove(parent, childIndex - 1);
+    }
+    else {
+        DEBUG_ASSERT(rightLeaf != nullptr);
+        BTreeLeafMerge(leaf, rightLeaf);
+        RecycleLeaf(rightLeaf);
+        BTreeInternalRemove(parent, childIndex);
+    }
+}
+
+template <typename K, typename V, typename Allocator>
+void BTreeMap<K, V, Allocator>::RebalanceInternal(Internal* internalNode, Internal* parent, uint32 childIndex)
+{
+    Internal* leftInternal = childIndex > 0 ? (Internal*)parent->children[childIndex - 1] : nullptr;
+    Internal* rightInternal = childIndex < parent->size ? (Internal*)parent->children[childIndex + 1] : nullptr;
+
+    if (leftInternal != nullptr && leftInternal->size > NODE_MIN_KEYS) {
+        // Rotate right through the parent separator
+        MemMove(internalNode->keys + 1, internalNode->keys, internalNode->size * sizeof(K));
+        MemMove(internalNode->children + 1, internalNode->children, (internalNode->size + 1) * sizeof(void*));
+        internalNode->keys[0] = parent->keys[childIndex - 1];
+        internalNode->children[0] = leftInternal->children[leftInternal->size];
+        internalNode->size++;
+        parent->keys[childIndex - 1] = leftInternal->keys[leftInternal->size - 1];
+        leftInternal->size--;
+    }
+    else if (rightInternal != nullptr && rightInternal->size > NODE_MIN_KEYS) {
+        // Rotate left through the parent separator
+        internalNode->keys[internalNode->size] = parent->keys[childIndex];
+        internalNode->children[internalNode->size + 1] = rightInternal->children[0];
+        internalNode->size++;
+        parent->keys[childIndex] = rightInternal->keys[0];
+        MemMove(rightInternal->keys, rightInternal->keys + 1, (rightInternal->size - 1) * sizeof(K));
+        MemMove(rightInternal->children, rightInternal->children + 1, rightInternal->size * sizeof(void*));
+        rightInternal->size--;
+    }
+    else if (leftInternal != nullptr) {
+        BTreeInternalMerge(leftInternal, parent->keys[childIndex - 1], internalNode);
+        RecycleInternal(internalNode);
+        BTreeInternalRemove(parent, childIndex - 1);
+    }
+    else {
+        DEBUG_ASSERT(rightInternal != nullptr);
+        BTreeInternalMerge(internalNode, parent->keys[childIndex], rightInternal);
+        RecycleInternal(rightInternal);
+        BTreeInternalRemove(parent, childIndex);
+    }
+}
+
+template <typename K, typename V>
+KeyValueRef<K, V> FlatMapIterator<K, V>::operator*() const
+{
+    return { keys[index], values[index] };
+}
+
+template <typename K, typename V>
+FlatMapIterator<K, V>& FlatMapIterator<K, V>::operator++()
+{
+    index++;
+    return *this;
+}
+
+template <typename K, typename V>
+bool FlatMapIterator<K, V>::operator==(const FlatMapIterator<K, V>& other) const
+{
+    return keys == other.keys && index == other.index;
+}
+
+template <typename K, typename V>
+bool FlatMapIterator<K, V>::operator!=(const FlatMapIterator<K, V>& other) const
+{
+    return !(*this == other);
+}
+
+template <typename K, typename V, typename Allocator>
+FlatMap<K, V, Allocator>::FlatMap(Allocator* allocator, uint32 capacity)
+: keys(allocator, capacity), values(allocator, capacity)
+{
+}
+
+template <typename K, typename V, typename Allocator>
+void FlatMap<K, V, Allocator>::Add(const K& key, const V& value)
+{
+    *(Add(key)) = value;
+}
+
+template <typename K, typename V, typename Allocator>
+V* FlatMap<K, V, Allocator>::Add(const K& key)
+{
+    const uint32 index = LowerBoundIndex(keys.data, keys.size, key);
+    DEBUG_ASSERT(index == keys.size || key < keys.data[index]);
+
+    keys.Append();
+    values.Append();
+    const uint32 numMoved = keys.size - index - 1;
+    MemMove(keys.data + index + 1, keys.data + index, numMoved * sizeof(K));
+    MemMove(values.data + index + 1, values.data + index, numMoved * sizeof(V));
+    keys.data[index] = key;
+
+    return &values.data[index];
+}
+
+template <typename K, typename V, typename Allocator>
+V* FlatMap<K, V, Allocator>::GetValue(const K& key)
+{
+    const uint32 index = LowerBoundIndex(keys.data, keys.size, key);
+    if (index == keys.size || key < keys.data[index]) {
+        return nullptr;
+    }
+    return &values.data[index];
+}
+
+template <typename K, typename V, typename Allocator>
+const V* FlatMap<K, V, Allocator>::GetValue(const K& key) const
+{
+    return const_cast<FlatMap<K, V, Allocator>*>(this)->GetValue(key);
+}
+
+template <typename K, typename V, typename Allocator>
+bool FlatMap<K, V, Allocator>::Remove(const K& key)
+{
+    const uint32 index = LowerBoundIndex(keys.data, keys.size, key);
+    if (index == keys.size || key < keys.data[index]) {
+        return false;
+    }
+
+    const uint32 numMoved = keys.size - index - 1;
+    MemMove(keys.data + index, keys.data + index + 1, numMoved * sizeof(K));
+    MemMove(values.data + index, values.data + index + 1, numMoved * sizeof(V));
+    keys.RemoveLast();
+    values.RemoveLast();
+    return true;
+}
+
+template <typename K, typename V, typename Allocator>
+FlatMapIterator<K, V> FlatMap<K, V, Allocator>::LowerBound(const K& key) const
+{
+    return { .keys = keys.data, .values = values.data, .index = LowerBoundIndex(keys.data, keys.size, key) };
+}
+
+template <typename K, typename V, typename Allocator>
+FlatMapIterator<K, V> FlatMap<K, V, Allocator>::UpperBound(const K& key) const
+{
+    return { .keys = keys.data, .values = values.data, .index = UpperBoundIndex(keys.data, keys.size, key) };
+}
+
+template <typename K, typename V, typename Allocator>
+FlatMapIterator<K, V> FlatMap<K, V, Allocator>::begin() const
+{
+    return { .keys = keys.data, .values = values.data, .index = 0 };
+}
+
+template <typename K, typename V, typename Allocator>
+FlatMapIterator<K, V> FlatMap<K, V, Allocator>::end() const
+{
+    return { .keys = keys.data, .values = values.data, .index = keys.size };
+}
+
+template <typename K, typename V, typename Allocator>
+void FlatMap<K, V, Allocator>::Clear()
+{
+    keys.Clear();
+    values.Clear();
+}
+
+template <typename K, typename V, typename Allocator>
+void FlatMap<K, V, Allocator>::Initialize(Allocator* allocator, uint32 capacity)
+{
+    keys.Initialize(allocator, capacity);
+    values.Initialize(allocator, capacity);
+}
+
+template <typename K, typename V, typename Allocator>
+void FlatMap<K, V, Allocator>::Free()
+{
+    keys.Free();
+    values.Free();
+}
+
+// Big enough that the HashTable never has to grow with maxItems keys
+internal uint32 LruCacheIndicesCapacity(uint32 maxItems)
+{
+    return (uint32)((float32)maxItems / HASH_TABLE_MAX_SIZE_TO_CAPACITY) + 2;
+}
+
+template <typename V, typename Allocator>
+LruCache<V, Allocator>::LruCache(Allocator* allocator, uint32 maxItems, uint64 maxBytes)
+: indices(allocator, LruCacheIndicesCapacity(maxItems)), entries(allocator, maxItems)
+{
+    DEBUG_ASSERT(maxItems > 0);
+
+    size = 0;
+    this->maxItems = maxItems;
+    bytes = 0;
+    this->maxBytes = maxBytes;
+    newest = UINT32_MAX_VALUE;
+    oldest = UINT32_MAX_VALUE;
+    freeList = UINT32_MAX_VALUE;
+    evictCallback = nullptr;
+    evictUserData = nullptr;
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::SetEvictCallback(EvictCallback callback, void* userData)
+{
+    evictCallback = callback;
+    evictUserData = userData;
+}
+
+template <typename V, typename Allocator>
+V* LruCache<V, Allocator>::Get(const HashKey& key)
+{
+    const uint32* index = indices.GetValue(key);
+    if (index == nullptr) {
+        return nullptr;
+    }
+
+    if (*index != newest) {
+        Unlink(*index);
+        LinkNewest(*index);
+    }
+    return &entries[*index].value;
+}
+
+template <typename V, typename Allocator>
+const V* LruCache<V, Allocator>::Peek(const HashKey& key) const
+{
+    const uint32* index = indices.GetValue(key);
+    if (index == nullptr) {
+        return nullptr;
+    }
+    return &entries[*index].value;
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::Put(const HashKey& key, const V& value, uint64 itemBytes)
+{
+    *(Put(key, itemBytes)) = value;
+}
+
+template <typename V, typename Allocator>
+V* LruCache<V, Allocator>::Put(const HashKey& key, uint64 itemBytes)
+{
+    Remove(key);
+
+    while (size >= maxItems || (size > 0 && maxBytes != 0 && bytes + itemBytes > maxBytes)) {
+        EvictOldest();
+    }
+
+    uint32 index;
+    if (freeList != UINT32_MAX_VALUE) {
+        index = freeList;
+        freeList = entries[index].next;
+    }
+    else {
+        // Never grows past the initial capacity of maxItems, so value pointers are stable
+        DEBUG_ASSERT(entries.size < entries.capacity);
+        index = entries.size;
+        entries.Append();
+    }
+
+    LruCacheEntry<V>& entry = entries[index];
+    entry.key = key;
+    entry.bytes = itemBytes;
+    LinkNewest(index);
+    indices.Add(key, index);
+
+    size++;
+    bytes += itemBytes;
+    return &entry.value;
+}
+
+template <typename V, typename Allocator>
+bool LruCache<V, Allocator>::Remove(const HashKey& key)
+{
+    const uint32* index = indices.GetValue(key);
+    if (index == nullptr) {
+        return false;
+    }
+
+    RemoveEntry(*index);
+    return true;
+}
+
+template <typename V, typename Allocator>
+bool LruCache<V, Allocator>::EvictOldest()
+{
+    if (oldest == UINT32_MAX_VALUE) {
+        return false;
+    }
+
+    RemoveEntry(oldest);
+    return true;
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::Clear()
+{
+    while (EvictOldest()) {}
+
+    entries.Clear();
+    freeList = UINT32_MAX_VALUE;
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::Initialize(Allocator* allocator, uint32 maxItems, uint64 maxBytes)
+{
+    DEBUG_ASSERT(maxItems > 0);
+
+    indices.Initialize(allocator, LruCacheIndicesCapacity(maxItems));
+    entries.Initialize(allocator, maxItems);
+
+    size = 0;
+    this->maxItems = maxItems;
+    bytes = 0;
+    this->maxBytes = maxBytes;
+    newest = UINT32_MAX_VALUE;
+    oldest = UINT32_MAX_VALUE;
+    freeList = UINT32_MAX_VALUE;
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::Free()
+{
+    Clear();
+    indices.Free();
+    entries.Free();
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::Unlink(uint32 index)
+{
+    LruCacheEntry<V>& entry = entries[index];
+    if (entry.prev != UINT32_MAX_VALUE) {
+        entries[entry.prev].next = entry.next;
+    }
+    else {
+        newest = entry.next;
+    }
+    if (entry.next != UINT32_MAX_VALUE) {
+        entries[entry.next].prev = entry.prev;
+    }
+    else {
+        oldest = entry.prev;
+    }
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::LinkNewest(uint32 index)
+{
+    LruCacheEntry<V>& entry = entries[index];
+    entry.prev = UINT32_MAX_VALUE;
+    entry.next = newest;
+    if (newest != UINT32_MAX_VALUE) {
+        entries[newest].prev = index;
+    }
+    newest = index;
+    if (oldest == UINT32_MAX_VALUE) {
+        oldest = index;
+    }
+}
+
+template <typename V, typename Allocator>
+void LruCache<V, Allocator>::RemoveEntry(uint32 index)
+{
+    LruCacheEntry<V>& entry = entries[index];
+    if (evictCallback != nullptr) {
+        evictCallback(entry.key, &entry.value, evictUserData);
+    }
+
+    Unlink(index);
+    indices.Remove(entry.key);
+    size--;
+    bytes -= entry.bytes;
+
+    entry.next = freeList;
+    freeList = index;
+}
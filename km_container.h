@@ -6,8 +6,12 @@
 
 static const uint32 DYNAMIC_ARRAY_START_CAPACITY = 16;
 
-// TODO pretty high, maybe do lower
-static const uint32 HASH_TABLE_START_CAPACITY = 89;
+// Number of slots, rounded up to a power of 2. HashTables grow, so this can stay small.
+static const uint32 HASH_TABLE_START_CAPACITY = 32;
+
+// Bytes taken by the keys of one BTreeMap node, so a node search touches a handful of cache lines
+static const uint32 BTREE_NODE_KEY_BYTES = 256;
+static const uint32 BTREE_MAX_DEPTH = 32;
 
 // NOTE: Adding things to this container might invalidate pointers to elements.
 // Subtle case that confused me: getting pointers through Append 3 times in a row, and only afterward
@@ -33,7 +37,7 @@ struct DynamicArray
     void Append(const Array<const T>& array);
     void RemoveLast();
 
-    uint32 IndexOf(const T& value);
+    uint32 IndexOf(const T& value) const;
 
     void Clear();
     void Initialize(Allocator* allocator = nullptr, uint32 capacity = DYNAMIC_ARRAY_START_CAPACITY);
@@ -62,40 +66,331 @@ struct HashKey
     bool WriteString(const char* str);
 };
 
-template <typename V>
+// djb2, same as KeyHash on a HashKey, but usable in constant expressions
+constexpr uint32 KeyHashConstexpr(const char* str, uint32 size)
+{
+    uint32 hash = 5381;
+    for (uint32 i = 0; i < size; i++) {
+        hash = ((hash << 5) + hash) + str[i];
+    }
+    return hash;
+}
+
+// Key with a precomputed hash. Looks up tables keyed on HashKey or Array<const char> directly,
+// without building a HashKey or hashing the string. Usually made by KM_KEY.
+struct HashedKey
+{
+    const char* data;
+    uint32 size;
+    uint32 hash;
+};
+
+// Template argument forces the hash to be computed at compile time, even in debug builds
+template <uint32 HASH, uint32 SIZE>
+struct HashedKeyConstant
+{
+    static_assert(SIZE <= HashKey::MAX_LENGTH, "KM_KEY string longer than HashKey::MAX_LENGTH");
+    static const uint32 VALUE = HASH;
+};
+
+// HashedKey from a string literal, hashed at compile time: kmkv.GetValue(KM_KEY("name"))
+#define KM_KEY(str) (HashedKey { \
+    .data = (str), \
+    .size = sizeof(str) - 1, \
+    .hash = HashedKeyConstant<KeyHashConstexpr((str), sizeof(str) - 1), sizeof(str) - 1>::VALUE \
+})
+
+template <typename V, typename K = HashKey>
 struct KeyValuePair
 {
-    HashKey key;
+    K key;
     V value;
 };
 
-template <typename V, typename Allocator = StandardAllocator>
+struct HashSlot
+{
+    uint32 hash;
+    uint32 index; // index into pairs + 1, 0 for an empty slot
+};
+
+// Items are stored densely in pairs, in insertion order, and found through a separate open-addressed
+// table of slots. Iterating (range-for over KeyValuePair) only touches the size live items.
+// NOTE: Remove moves the last pair into the removed one's place, which changes the iteration order.
+// Adding items might invalidate pointers to values, same as DynamicArray.
+// Keys can be HashKey, or any type with KeyHash and KeyCompare overloads (see integer keys below).
+template <typename V, typename Allocator = StandardAllocator, typename K = HashKey>
 struct HashTable
 {
     uint32 size;
-    uint32 capacity;
-    KeyValuePair<V>* pairs;
+    uint32 capacity; // number of slots, always a power of 2
+    KeyValuePair<V, K>* pairs;
+    HashSlot* slots;
     Allocator* allocator;
 
     HashTable(Allocator* allocator = nullptr, uint32 capacity = HASH_TABLE_START_CAPACITY);
-    HashTable(const HashTable<V, Allocator>& other) = delete;
+    HashTable(const HashTable<V, Allocator, K>& other) = delete;
     ~HashTable();
 
-    void Add(const HashKey& key, const V& value);
-    V* Add(const HashKey& key);
-    V* GetValue(const HashKey& key);
-    const V* GetValue(const HashKey& key) const;
-    bool Remove(const HashKey& key);
+    void Add(const K& key, const V& value);
+    V* Add(const K& key);
+    V* GetValue(const K& key);
+    const V* GetValue(const K& key) const;
+    // Skips hashing, for string keys only (see KM_KEY)
+    V* GetValue(const HashedKey& key);
+    const V* GetValue(const HashedKey& key) const;
+    bool Remove(const K& key);
+
+    KeyValuePair<V, K>* begin();
+    KeyValuePair<V, K>* end();
+    const KeyValuePair<V, K>* begin() const;
+    const KeyValuePair<V, K>* end() const;
 
     void Clear();
     void Initialize(Allocator* allocator = nullptr, uint32 capacity = HASH_TABLE_START_CAPACITY);
     void Free();
 
-    HashTable<V, Allocator>& operator=(const HashTable<V, Allocator>& other);
+    HashTable<V, Allocator, K>& operator=(const HashTable<V, Allocator, K>& other);
 
     private:
-    KeyValuePair<V>* GetPair(const HashKey& key) const;
-    KeyValuePair<V>* GetFreeSlot(const HashKey& key);
+    template <typename Q> uint32 FindSlot(const Q& key, uint32 hash) const;
+    void InsertSlot(uint32 hash, uint32 pairIndex);
+    void RemoveSlot(uint32 slotIndex);
+    bool UpdateCapacity(uint32 newCapacity);
 };
 
+struct HashSetNone
+{
+};
+
+template <typename K>
+struct HashSetIterator
+{
+    const KeyValuePair<HashSetNone, K>* pair;
+
+    const K& operator*() const;
+    HashSetIterator<K>& operator++();
+    bool operator==(const HashSetIterator<K>& other) const;
+    bool operator!=(const HashSetIterator<K>& other) const;
+};
+
+// HashTable without values, same storage and iteration order rules
+template <typename K = HashKey, typename Allocator = StandardAllocator>
+struct HashSet
+{
+    HashTable<HashSetNone, Allocator, K> table;
+
+    HashSet(Allocator* allocator = nullptr, uint32 capacity = HASH_TABLE_START_CAPACITY);
+    HashSet(const HashSet<K, Allocator>& other) = delete;
+
+    // Returns false if the key was already in the set
+    bool Add(const K& key);
+    bool Contains(const K& key) const;
+    bool Remove(const K& key);
+
+    HashSetIterator<K> begin() const;
+    HashSetIterator<K> end() const;
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr, uint32 capacity = HASH_TABLE_START_CAPACITY);
+    void Free();
+};
+
+uint32 KeyHash(const HashKey& key);
+uint32 KeyHash(uint32 key);
+uint32 KeyHash(uint64 key);
+uint32 KeyHash(int32 key);
+uint32 KeyHash(int64 key);
 bool KeyCompare(const HashKey& key1, const HashKey& key2);
+bool KeyCompare(uint32 key1, uint32 key2);
+bool KeyCompare(uint64 key1, uint64 key2);
+bool KeyCompare(int32 key1, int32 key2);
+bool KeyCompare(int64 key1, int64 key2);
+
+template <typename K, typename V>
+struct KeyValueRef
+{
+    const K& key;
+    V& value;
+};
+
+template <typename K, typename V, uint32 N>
+struct BTreeLeaf
+{
+    uint32 size;
+    BTreeLeaf<K, V, N>* prev;
+    BTreeLeaf<K, V, N>* next;
+    K keys[N];
+    V values[N];
+};
+
+template <typename K, uint32 N>
+struct BTreeInternal
+{
+    uint32 size; // number of keys, there are size + 1 children
+    K keys[N];
+    void* children[N + 1];
+};
+
+template <typename K, typename V, uint32 N>
+struct BTreeIterator
+{
+    BTreeLeaf<K, V, N>* leaf;
+    uint32 index;
+
+    KeyValueRef<K, V> operator*() const;
+    BTreeIterator<K, V, N>& operator++();
+    bool operator==(const BTreeIterator<K, V, N>& other) const;
+    bool operator!=(const BTreeIterator<K, V, N>& other) const;
+};
+
+// B+tree, ordered by K's operator<. Values live in linked leaves for in-order iteration and range queries.
+// Nodes freed by Remove or Clear are kept on free lists and reused, never handed back to the allocator
+// until Free, so this is safe to use with a LinearAllocator.
+// NOTE: Add and Remove invalidate iterators and value pointers.
+template <typename K, typename V, typename Allocator = StandardAllocator>
+struct BTreeMap
+{
+    static const uint32 NODE_KEYS = BTREE_NODE_KEY_BYTES / sizeof(K) < 4 ? 4 : BTREE_NODE_KEY_BYTES / sizeof(K);
+    static const uint32 NODE_MIN_KEYS = NODE_KEYS / 2;
+
+    using Leaf = BTreeLeaf<K, V, NODE_KEYS>;
+    using Internal = BTreeInternal<K, NODE_KEYS>;
+    using Iterator = BTreeIterator<K, V, NODE_KEYS>;
+
+    uint32 size;
+    uint32 depth; // number of internal node levels above the leaves
+    void* root;
+    Leaf* first;
+    void* freeLeaves;
+    void* freeInternals;
+    Allocator* allocator;
+
+    BTreeMap(Allocator* allocator = nullptr);
+    BTreeMap(const BTreeMap<K, V, Allocator>& other) = delete;
+
+    void Add(const K& key, const V& value);
+    V* Add(const K& key);
+    V* GetValue(const K& key);
+    const V* GetValue(const K& key) const;
+    bool Remove(const K& key);
+
+    // First item with key >= the given key, and first item with key > the given key
+    Iterator LowerBound(const K& key) const;
+    Iterator UpperBound(const K& key) const;
+    Iterator begin() const;
+    Iterator end() const;
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr);
+    void Free();
+
+    private:
+    Leaf* FindLeaf(const K& key) const;
+    Iterator MakeIterator(Leaf* leaf, uint32 index) const;
+
+    Leaf* NewLeaf();
+    Internal* NewInternal();
+    void RecycleLeaf(Leaf* leaf);
+    void RecycleInternal(Internal* internalNode);
+    void RecycleSubtree(void* node, uint32 level);
+    void FreeSubtree(void* node, uint32 level);
+
+    void RebalanceLeaf(Leaf* leaf, Internal* parent, uint32 childIndex);
+    void RebalanceInternal(Internal* internalNode, Internal* parent, uint32 childIndex);
+};
+
+template <typename K, typename V>
+struct FlatMapIterator
+{
+    const K* keys;
+    V* values;
+    uint32 index;
+
+    KeyValueRef<K, V> operator*() const;
+    FlatMapIterator<K, V>& operator++();
+    bool operator==(const FlatMapIterator<K, V>& other) const;
+    bool operator!=(const FlatMapIterator<K, V>& other) const;
+};
+
+// Sorted key and value arrays, ordered by K's operator< and binary searched.
+// Better than BTreeMap for small or read-mostly maps, but Add and Remove are linear time.
+template <typename K, typename V, typename Allocator = StandardAllocator>
+struct FlatMap
+{
+    DynamicArray<K, Allocator> keys;
+    DynamicArray<V, Allocator> values;
+
+    FlatMap(Allocator* allocator = nullptr, uint32 capacity = DYNAMIC_ARRAY_START_CAPACITY);
+    FlatMap(const FlatMap<K, V, Allocator>& other) = delete;
+
+    void Add(const K& key, const V& value);
+    V* Add(const K& key);
+    V* GetValue(const K& key);
+    const V* GetValue(const K& key) const;
+    bool Remove(const K& key);
+
+    FlatMapIterator<K, V> LowerBound(const K& key) const;
+    FlatMapIterator<K, V> UpperBound(const K& key) const;
+    FlatMapIterator<K, V> begin() const;
+    FlatMapIterator<K, V> end() const;
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr, uint32 capacity = DYNAMIC_ARRAY_START_CAPACITY);
+    void Free();
+};
+
+static const uint32 LRU_CACHE_START_MAX_ITEMS = 64;
+
+template <typename V>
+struct LruCacheEntry
+{
+    HashKey key;
+    V value;
+    uint64 bytes;
+    uint32 prev, next; // entry indices, UINT32_MAX_VALUE for none
+};
+
+// Fixed-capacity cache that evicts the least recently used items. Limited by item count, and optionally
+// by total size in bytes (as reported to Put). Recency is an intrusive doubly linked list over the entries,
+// and a HashTable maps keys to entry indices, so Get, Put and evictions are all O(1).
+// Value pointers stay valid until that item leaves the cache.
+template <typename V, typename Allocator = StandardAllocator>
+struct LruCache
+{
+    // Called for every value that leaves the cache: evicted, replaced by Put, removed or cleared
+    using EvictCallback = void (*)(const HashKey& key, V* value, void* userData);
+
+    uint32 size;
+    uint32 maxItems;
+    uint64 bytes;
+    uint64 maxBytes; // 0 for no byte limit
+    uint32 newest, oldest, freeList;
+    EvictCallback evictCallback;
+    void* evictUserData;
+    HashTable<uint32, Allocator> indices;
+    DynamicArray<LruCacheEntry<V>, Allocator> entries;
+
+    LruCache(Allocator* allocator = nullptr, uint32 maxItems = LRU_CACHE_START_MAX_ITEMS, uint64 maxBytes = 0);
+    LruCache(const LruCache<V, Allocator>& other) = delete;
+
+    void SetEvictCallback(EvictCallback callback, void* userData);
+
+    // Get marks the item as most recently used, Peek doesn't
+    V* Get(const HashKey& key);
+    const V* Peek(const HashKey& key) const;
+    // Evicts old items until the new one fits. An item bigger than maxBytes on its own is still added.
+    void Put(const HashKey& key, const V& value, uint64 itemBytes = 0);
+    V* Put(const HashKey& key, uint64 itemBytes = 0);
+    bool Remove(const HashKey& key);
+    bool EvictOldest();
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr, uint32 maxItems = LRU_CACHE_START_MAX_ITEMS,
+                    uint64 maxBytes = 0);
+    void Free();
+
+    private:
+    void Unlink(uint32 index);
+    void LinkNewest(uint32 index);
+    void RemoveEntry(uint32 index);
+};
@@ -0,0 +1,594 @@
+#include "km_json.h"
+
+#include "km_simd.h"
+
+// Character classes of a 64-byte block, bit i is block[i]
+struct JsonBlockMasks
+{
+    uint64 quote;
+    uint64 backslash;
+    uint64 structural; // { } [ ] : ,
+    uint64 open; // { [
+    uint64 whitespace;
+};
+
+internal void JsonClassifyBlock(const char* block, JsonBlockMasks* masks)
+{
+#if KM_SIMD_SSE2
+    *masks = {};
+    for (int i = 0; i < 4; i++) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(block + i * 16));
+        // Setting the 0x20 bit maps '[' to '{' and ']' to '}', and nothing else onto either
+        const __m128i folded = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        const __m128i open = _mm_cmpeq_epi8(folded, _mm_set1_epi8('{'));
+        const __m128i structural = _mm_or_si128(
+            _mm_or_si128(open, _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(':')), _mm_cmpeq_epi8(chars, _mm_set1_epi8(',')))
+        );
+        const __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')))
+        );
+
+        const int shift = i * 16;
+        masks->quote |= (uint64)(uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"'))) << shift;
+        masks->backslash |= (uint64)(uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'))) << shift;
+        masks->structural |= (uint64)(uint32)_mm_movemask_epi8(structural) << shift;
+        masks->open |= (uint64)(uint32)_mm_movemask_epi8(open) << shift;
+        masks->whitespace |= (uint64)(uint32)_mm_movemask_epi8(whitespace) << shift;
+    }
+#else
+    *masks = {};
+    for (int i = 0; i < 64; i++) {
+        const uint64 bit = 1ULL << i;
+        switch (block[i]) {
+            case '"': masks->quote |= bit; break;
+            case '\\': masks->backslash |= bit; break;
+            case '{': case '[': masks->open |= bit; masks->structural |= bit; break;
+            case '}': case ']': case ':': case ',': masks->structural |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': masks->whitespace |= bit; break;
+        }
+    }
+#endif
+}
+
+/*
+Stage 1: positions of every structural character, opening quote and scalar start outside of strings,
+in order. Also counts the tape entries stage 2 will need, since closing brackets, colons and commas
+don't get one.
+*/
+internal bool IndexJson(const_string json, DynamicArray<uint32>* outIndices, uint32* outNumValues,
+                        bool* outHasEscapes)
+{
+    uint64 escapeCarry = 0; // bit 0 set if the next block starts with an escaped character
+    uint64 inStringCarry = 0; // all ones if the previous block ended inside a string
+    uint64 boundaryCarry = 1; // bit 0 set if the previous block ended on whitespace, structural or quote
+    uint32 numValues = 0;
+    bool hasEscapes = false;
+
+    char padded[64];
+    for (uint32 blockStart = 0; blockStart < json.size; blockStart += 64) {
+        const char* block = json.data + blockStart;
+        if (json.size - blockStart < 64) {
+            MemSet(padded, ' ', 64);
+            MemCopy(padded, block, json.size - blockStart);
+            block = padded;
+        }
+
+        JsonBlockMasks masks;
+        JsonClassifyBlock(block, &masks);
+
+        // A backslash escapes the next character, unless it's escaped itself. Backslashes are rare
+        // enough that walking them one by one beats the branchless odd-length-run trick.
+        uint64 escaped = escapeCarry;
+        escapeCarry = 0;
+        if (masks.backslash != 0) {
+            hasEscapes = true;
+            uint64 backslash = masks.backslash & ~escaped;
+            while (backslash != 0) {
+                const uint32 i = CountTrailingZeros64(backslash);
+                if (i == 63) {
+                    escapeCarry = 1;
+                    break;
+                }
+                escaped |= 1ULL << (i + 1);
+                backslash &= ~((2ULL << (i + 1)) - 1);
+            }
+        }
+
+        // Prefix XOR of the quotes: set from an opening quote up to, not including, its closing quote
+        const uint64 quotes = masks.quote & ~escaped;
+        uint64 inString = quotes;
+        inString ^= inString << 1;
+        inString ^= inString << 2;
+        inString ^= inString << 4;
+        inString ^= inString << 8;
+        inString ^= inString << 16;
+        inString ^= inString << 32;
+        inString ^= inStringCarry;
+        inStringCarry = (uint64)((int64)inString >> 63);
+
+        // Scalars (numbers, true, false, null) start on anything else that follows a boundary
+        const uint64 boundary = masks.structural | masks.whitespace | quotes;
+        const uint64 scalarStarts = ~(boundary | inString) & ((boundary << 1) | boundaryCarry);
+        boundaryCarry = boundary >> 63;
+
+        const uint64 openQuotes = quotes & inString;
+        uint64 structurals = (masks.structural & ~inString) | openQuotes | scalarStarts;
+        numValues += PopCount64((masks.open & ~inString) | openQuotes | scalarStarts);
+
+        if (outIndices->capacity - outIndices->size < 64) {
+            if (!outIndices->UpdateCapacity(outIndices->capacity * 2 + 64)) {
+                LOG_ERROR("Failed to grow JSON structural index\n");
+                return false;
+            }
+        }
+        uint32* indices = outIndices->data + outIndices->size;
+        while (structurals != 0) {
+            *indices++ = blockStart + CountTrailingZeros64(structurals);
+            structurals &= structurals - 1;
+        }
+        outIndices->size = (uint32)(indices - outIndices->data);
+    }
+
+    if (inStringCarry != 0) {
+        LOG_ERROR("Unterminated JSON string\n");
+        return false;
+    }
+
+    *outNumValues = numValues;
+    *outHasEscapes = hasEscapes;
+    return true;
+}
+
+// Position of the first quote, backslash or control character from start on, or json.size
+internal uint32 FindJsonStringSpecial(const_string json, uint32 start)
+{
+    uint32 i = start;
+#if KM_SIMD_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i controlMax = _mm_set1_epi8(0x1f);
+    for (; json.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(json.data + i));
+        const __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chars, controlMax), controlMax);
+        const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, quote),
+                                                          _mm_cmpeq_epi8(chars, backslash)), control);
+        const uint32 mask = (uint32)_mm_movemask_epi8(special);
+        if (mask != 0) {
+            return i + CountTrailingZeros32(mask);
+        }
+    }
+#endif
+    for (; i < json.size; i++) {
+        const char c = json[i];
+        if (c == '"' || c == '\\' || (uint8)c < 0x20) {
+            return i;
+        }
+    }
+    return json.size;
+}
+
+internal bool ParseJsonHex4(const_string json, uint32 start, uint32* outValue)
+{
+    if (json.size - start < 4) {
+        return false;
+    }
+
+    uint32 value = 0;
+    for (uint32 i = start; i < start + 4; i++) {
+        const char c = json[i];
+        const char lower = c | 0x20;
+        uint32 digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        }
+        else if (lower >= 'a' && lower <= 'f') {
+            digit = lower - 'a' + 10;
+        }
+        else {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+
+    *outValue = value;
+    return true;
+}
+
+internal char* JsonEncodeUtf8(uint32 codePoint, char* dst)
+{
+    if (codePoint < 0x80) {
+        *dst++ = (char)codePoint;
+    }
+    else if (codePoint < 0x800) {
+        *dst++ = (char)(0xc0 | (codePoint >> 6));
+        *dst++ = (char)(0x80 | (codePoint & 0x3f));
+    }
+    else if (codePoint < 0x10000) {
+        *dst++ = (char)(0xe0 | (codePoint >> 12));
+        *dst++ = (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        *dst++ = (char)(0x80 | (codePoint & 0x3f));
+    }
+    else {
+        *dst++ = (char)(0xf0 | (codePoint >> 18));
+        *dst++ = (char)(0x80 | ((codePoint >> 12) & 0x3f));
+        *dst++ = (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        *dst++ = (char)(0x80 | (codePoint & 0x3f));
+    }
+    return dst;
+}
+
+/*
+start is the opening quote. Returns the position after the closing quote, or 0 on errors.
+Strings with escapes are unescaped at *strings, which is then moved past them. Unescaping never
+makes a string longer, so a strings buffer as big as the input is always enough.
+*/
+internal uint32 ParseJsonString(const_string json, uint32 start, char** strings, Array<const char>* outString)
+{
+    uint32 i = FindJsonStringSpecial(json, start + 1);
+    if (i < json.size && json[i] == '"') {
+        *outString = json.Slice(start + 1, i);
+        return i + 1;
+    }
+    if (i == json.size) {
+        LOG_ERROR("Unterminated JSON string at byte %d\n", start);
+        return 0;
+    }
+    if (json[i] != '\\') {
+        LOG_ERROR("Unescaped control character in JSON string at byte %d\n", i);
+        return 0;
+    }
+
+    char* dst = *strings;
+    MemCopy(dst, json.data + start + 1, i - start - 1);
+    dst += i - start - 1;
+    while (true) {
+        if (i == json.size) {
+            LOG_ERROR("Unterminated JSON string at byte %d\n", start);
+            return 0;
+        }
+
+        const char c = json[i];
+        if (c == '"') {
+            break;
+        }
+        if (c != '\\') {
+            LOG_ERROR("Unescaped control character in JSON string at byte %d\n", i);
+            return 0;
+        }
+
+        if (i + 1 == json.size) {
+            LOG_ERROR("Unterminated JSON string at byte %d\n", start);
+            return 0;
+        }
+        const char escape = json[i + 1];
+        i += 2;
+        switch (escape) {
+            case '"': *dst++ = '"'; break;
+            case '\\': *dst++ = '\\'; break;
+            case '/': *dst++ = '/'; break;
+            case 'b': *dst++ = '\b'; break;
+            case 'f': *dst++ = '\f'; break;
+            case 'n': *dst++ = '\n'; break;
+            case 'r': *dst++ = '\r'; break;
+            case 't': *dst++ = '\t'; break;
+            case 'u': {
+                uint32 codePoint;
+                if (!ParseJsonHex4(json, i, &codePoint)) {
+                    LOG_ERROR("Invalid JSON \\u escape at byte %d\n", i - 2);
+                    return 0;
+                }
+                i += 4;
+                if (codePoint >= 0xd800 && codePoint <= 0xdbff) {
+                    // UTF-16 surrogate pair, the low half has to follow right away
+                    uint32 low;
+                    if (json.size - i < 6 || json[i] != '\\' || json[i + 1] != 'u'
+                        || !ParseJsonHex4(json, i + 2, &low) || low < 0xdc00 || low > 0xdfff) {
+                        LOG_ERROR("Unpaired JSON UTF-16 surrogate at byte %d\n", i - 6);
+                        return 0;
+                    }
+                    i += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if (codePoint >= 0xdc00 && codePoint <= 0xdfff) {
+                    LOG_ERROR("Unpaired JSON UTF-16 surrogate at byte %d\n", i - 6);
+                    return 0;
+                }
+                dst = JsonEncodeUtf8(codePoint, dst);
+            } break;
+            default: {
+                LOG_ERROR("Invalid JSON escape \\%c at byte %d\n", escape, i - 2);
+                return 0;
+            } break;
+        }
+
+        const uint32 runEnd = FindJsonStringSpecial(json, i);
+        MemCopy(dst, json.data + i, runEnd - i);
+        dst += runEnd - i;
+        i = runEnd;
+    }
+
+    *outString = { .size = (uint32)(dst - *strings), .data = *strings };
+    *strings = dst;
+    return i + 1;
+}
+
+internal uint32 SkipJsonDigits(const_string json, uint32 start)
+{
+    uint32 i = start;
+    while (i < json.size && (uint8)(json[i] - '0') < 10) {
+        i++;
+    }
+    return i;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?  Returns the end, start if there's no valid number.
+internal uint32 ScanJsonNumber(const_string json, uint32 start)
+{
+    uint32 i = start;
+    if (i < json.size && json[i] == '-') {
+        i++;
+    }
+    if (i < json.size && json[i] == '0') {
+        i++;
+    }
+    else {
+        const uint32 end = SkipJsonDigits(json, i);
+        if (end == i) {
+            return start;
+        }
+        i = end;
+    }
+
+    if (i < json.size && json[i] == '.') {
+        const uint32 end = SkipJsonDigits(json, i + 1);
+        if (end == i + 1) {
+            return start;
+        }
+        i = end;
+    }
+    if (i < json.size && (json[i] == 'e' || json[i] == 'E')) {
+        i++;
+        if (i < json.size && (json[i] == '+' || json[i] == '-')) {
+            i++;
+        }
+        const uint32 end = SkipJsonDigits(json, i);
+        if (end == i) {
+            return start;
+        }
+        i = end;
+    }
+
+    return i;
+}
+
+// Scalars have to end at the end of the input, whitespace or a structural character
+internal bool IsJsonScalarEnd(const_string json, uint32 index)
+{
+    if (index == json.size) {
+        return true;
+    }
+
+    switch (json[index]) {
+        case ' ': case '\t': case '\n': case '\r':
+        case '{': case '}': case '[': case ']': case ':': case ',': {
+            return true;
+        } break;
+        default: {
+            return false;
+        } break;
+    }
+}
+
+enum class JsonExpect
+{
+    VALUE,
+    VALUE_OR_CLOSE, // after '['
+    KEY,
+    KEY_OR_CLOSE, // after '{'
+    COLON,
+    COMMA_OR_CLOSE,
+    END
+};
+
+// Stage 2: grammar checks and tape building, only visiting the positions found by IndexJson
+internal bool BuildJsonTape(const_string json, const Array<uint32>& indices, Array<JsonValue> tape, char* strings)
+{
+    uint32 stack[JSON_MAX_DEPTH];
+    uint32 depth = 0;
+    uint32 numValues = 0;
+    JsonExpect expect = JsonExpect::VALUE;
+
+    for (uint32 n = 0; n < indices.size; n++) {
+        const uint32 pos = indices[n];
+        const char c = json[pos];
+
+        if (expect == JsonExpect::COLON) {
+            if (c != ':') {
+                LOG_ERROR("Expected ':' after JSON key at byte %d\n", pos);
+                return false;
+            }
+            expect = JsonExpect::VALUE;
+            continue;
+        }
+        if (expect == JsonExpect::COMMA_OR_CLOSE && c == ',') {
+            expect = tape[stack[depth - 1]].type == JsonType::OBJECT ? JsonExpect::KEY : JsonExpect::VALUE;
+            continue;
+        }
+        if (c == '}' || c == ']') {
+            const JsonType closeType = c == '}' ? JsonType::OBJECT : JsonType::ARRAY;
+            const bool canClose = expect == JsonExpect::COMMA_OR_CLOSE || expect == JsonExpect::KEY_OR_CLOSE
+                || expect == JsonExpect::VALUE_OR_CLOSE;
+            if (!canClose || tape[stack[depth - 1]].type != closeType) {
+                LOG_ERROR("Unexpected '%c' in JSON at byte %d\n", c, pos);
+                return false;
+            }
+            tape[stack[--depth]].next = numValues;
+            expect = depth == 0 ? JsonExpect::END : JsonExpect::COMMA_OR_CLOSE;
+            continue;
+        }
+        // ',' and ':' have no tape slot, IndexJson only counts values
+        if (expect == JsonExpect::COMMA_OR_CLOSE || expect == JsonExpect::END || c == ',' || c == ':'
+            || numValues == tape.size) {
+            LOG_ERROR("Unexpected '%c' in JSON at byte %d\n", c, pos);
+            return false;
+        }
+
+        JsonValue* value = &tape[numValues++];
+        value->next = numValues;
+        if (expect == JsonExpect::KEY || expect == JsonExpect::KEY_OR_CLOSE) {
+            if (c != '"') {
+                LOG_ERROR("Expected JSON object key at byte %d\n", pos);
+                return false;
+            }
+            value->type = JsonType::STRING;
+            if (ParseJsonString(json, pos, &strings, &value->str) == 0) {
+                return false;
+            }
+            expect = JsonExpect::COLON;
+            continue;
+        }
+
+        switch (c) {
+            case '{':
+            case '[': {
+                if (depth == JSON_MAX_DEPTH) {
+                    LOG_ERROR("JSON nested deeper than %d at byte %d\n", JSON_MAX_DEPTH, pos);
+                    return false;
+                }
+                value->type = c == '{' ? JsonType::OBJECT : JsonType::ARRAY;
+                value->str = json.Slice(pos, pos + 1);
+                stack[depth++] = numValues - 1;
+                expect = c == '{' ? JsonExpect::KEY_OR_CLOSE : JsonExpect::VALUE_OR_CLOSE;
+                continue;
+            } break;
+            case '"': {
+                value->type = JsonType::STRING;
+                if (ParseJsonString(json, pos, &strings, &value->str) == 0) {
+                    return false;
+                }
+            } break;
+            case 't':
+            case 'f':
+            case 'n': {
+                const_string literal = c == 't' ? ToString("true") : c == 'f' ? ToString("false") : ToString("null");
+                const uint32 end = pos + literal.size;
+                if (end > json.size || !StringEquals(json.Slice(pos, end), literal) || !IsJsonScalarEnd(json, end)) {
+                    LOG_ERROR("Invalid JSON literal at byte %d\n", pos);
+                    return false;
+                }
+                value->type = c == 'n' ? JsonType::NULL_VALUE : JsonType::BOOL;
+                value->str = json.Slice(pos, end);
+            } break;
+            default: {
+                const uint32 end = ScanJsonNumber(json, pos);
+                if (end == pos || !IsJsonScalarEnd(json, end)) {
+                    LOG_ERROR("Invalid JSON value at byte %d\n", pos);
+                    return false;
+                }
+                value->type = JsonType::NUMBER;
+                value->str = json.Slice(pos, end);
+            } break;
+        }
+
+        expect = depth == 0 ? JsonExpect::END : JsonExpect::COMMA_OR_CLOSE;
+    }
+
+    if (expect != JsonExpect::END) {
+        LOG_ERROR("Unexpected end of JSON\n");
+        return false;
+    }
+
+    DEBUG_ASSERT(numValues == tape.size);
+    return true;
+}
+
+template <typename Allocator>
+JsonDocument<Allocator>::JsonDocument(Allocator* allocator)
+{
+    Initialize(allocator);
+}
+
+template <typename Allocator>
+uint32 JsonDocument<Allocator>::GetObjectValue(uint32 objectIndex, const_string key) const
+{
+    DEBUG_ASSERT(tape[objectIndex].type == JsonType::OBJECT);
+
+    for (uint32 i = objectIndex + 1; i < tape[objectIndex].next; i = tape[i + 1].next) {
+        if (StringEquals(tape[i].str, key)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+template <typename Allocator>
+void JsonDocument<Allocator>::Clear()
+{
+    // Reverse allocation order, for LinearAllocator
+    if (strings != nullptr) {
+        FreeOrUseDefautIfNull(allocator, strings);
+        strings = nullptr;
+    }
+    if (tape.data != nullptr) {
+        FreeOrUseDefautIfNull(allocator, tape.data);
+        tape = Array<JsonValue>::empty;
+    }
+}
+
+template <typename Allocator>
+void JsonDocument<Allocator>::Initialize(Allocator* allocator)
+{
+    tape = Array<JsonValue>::empty;
+    strings = nullptr;
+    this->allocator = allocator;
+}
+
+template <typename Allocator>
+void JsonDocument<Allocator>::Free()
+{
+    Clear();
+}
+
+template <typename Allocator>
+bool ParseJson(const_string json, JsonDocument<Allocator>* outDocument)
+{
+    outDocument->Clear();
+
+    // Temporary, on the default allocator so a LinearAllocator document stays contiguous
+    DynamicArray<uint32> indices(nullptr, json.size / 8 + 64);
+    defer(indices.Free());
+
+    uint32 numValues;
+    bool hasEscapes;
+    if (!IndexJson(json, &indices, &numValues, &hasEscapes)) {
+        return false;
+    }
+    if (numValues == 0) {
+        LOG_ERROR("Empty JSON\n");
+        return false;
+    }
+
+    outDocument->tape.data = (JsonValue*)AllocateOrUseDefaultIfNull(outDocument->allocator,
+                                                                      numValues * sizeof(JsonValue));
+    if (outDocument->tape.data == nullptr) {
+        LOG_ERROR("Failed to allocate JSON tape, %d values\n", numValues);
+        return false;
+    }
+    outDocument->tape.size = numValues;
+    if (hasEscapes) {
+        outDocument->strings = (char*)AllocateOrUseDefaultIfNull(outDocument->allocator, json.size);
+        if (outDocument->strings == nullptr) {
+            LOG_ERROR("Failed to allocate JSON strings, %d bytes\n", json.size);
+            outDocument->Clear();
+            return false;
+        }
+    }
+
+    if (!BuildJsonTape(json, indices.ToArray(), outDocument->tape, outDocument->strings)) {
+        outDocument->Clear();
+        return false;
+    }
+    return true;
+}
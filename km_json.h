@@ -0,0 +1,61 @@
+#pragma once
+
+#include "km_array.h"
+#include "km_memory.h"
+#include "km_string.h"
+
+/*
+JSON (RFC 8259) parser in two stages:
+1. SIMD pass over 64-byte blocks, indexing structural characters, string starts and scalar starts.
+   Quotes and backslash escapes are tracked as bitmasks, so characters inside strings are never visited.
+2. A walk over the indexed positions only, which checks the grammar and fills a flat tape.
+Strings without escapes are slices of the input, which has to outlive the document.
+UTF-8 inside strings isn't validated, see Utf8IsValid.
+*/
+static const uint32 JSON_MAX_DEPTH = 1024;
+
+enum class JsonType : uint32
+{
+    NULL_VALUE,
+    BOOL,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT
+};
+
+struct JsonValue
+{
+    JsonType type;
+    uint32 next; // tape index of the next sibling, past the contents of arrays and objects
+    // STRING: unescaped contents. NUMBER, BOOL, NULL_VALUE: the text as written, e.g. to use with
+    // StringToFloat64 (or StringToIntBase10 for integers) without losing precision to a float64.
+    Array<const char> str;
+};
+
+/*
+Tape layout: each value is followed by its contents. tape[0] is the root.
+Arrays hold values, objects hold key (STRING) and value pairs:
+    for (uint32 i = index + 1; i < tape[index].next; i = tape[i].next)                 // array
+    for (uint32 i = index + 1; i < tape[index].next; i = tape[i + 1].next) // i is key, i + 1 value
+*/
+template <typename Allocator = StandardAllocator>
+struct JsonDocument
+{
+    Array<JsonValue> tape;
+    char* strings; // unescaped strings, only allocated if the input has backslashes
+    Allocator* allocator;
+
+    JsonDocument(Allocator* allocator = nullptr);
+    JsonDocument(const JsonDocument<Allocator>& other) = delete;
+
+    // Tape index of the value for key in the object at objectIndex, or 0 if there's none (0 is the root)
+    uint32 GetObjectValue(uint32 objectIndex, const_string key) const;
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr);
+    void Free();
+};
+
+template <typename Allocator>
+bool ParseJson(const_string json, JsonDocument<Allocator>* outDocument);
@@ -1,9 +1,6 @@
 #include "km_kmkv.h"
 
-#ifdef KM_KMKV_JSON
-#include <cJSON.h>
-#endif
-
+#include "km_simd.h"
 #include "km_string.h"
 
 template <typename Allocator>
@@ -46,6 +43,7 @@ KmkvItem<Allocator>::~KmkvItem()
         case KmkvItemType::NONE: {
         } break;
         case KmkvItemType::STRING: {
+            dynamicStringPtr->Free();
             dynamicStringPtr->~DynamicArray();
             defaultAllocator_.Free(dynamicStringPtr);
         } break;
@@ -54,20 +52,30 @@ KmkvItem<Allocator>::~KmkvItem()
             defaultAllocator_.Free(hashTablePtr);
         } break;
     }
+    keywordTag.Free();
 }
 
-template <typename Allocator>
-DynamicArray<char, Allocator>* GetKmkvItemStrValue(
-                                                   HashTable<KmkvItem<Allocator>, Allocator>& kmkv, const HashKey& itemKey)
+// Item with the given key and type, KeyType is HashKey or HashedKey
+template <typename Allocator, typename KeyType>
+internal KmkvItem<Allocator>* GetKmkvItemOfType(HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                const KeyType& itemKey, KmkvItemType type)
 {
-    const KmkvItem<Allocator>* itemValuePtr = kmkv.GetValue(itemKey);
+    KmkvItem<Allocator>* itemValuePtr = kmkv.GetValue(itemKey);
     if (itemValuePtr == nullptr) {
         return nullptr;
     }
-    if (itemValuePtr->type != KmkvItemType::STRING) {
+    if (itemValuePtr->type != type) {
         return nullptr;
     }
-    return itemValuePtr->dynamicStringPtr;
+    return itemValuePtr;
+}
+
+template <typename Allocator>
+DynamicArray<char, Allocator>* GetKmkvItemStrValue(
+                                                   HashTable<KmkvItem<Allocator>, Allocator>& kmkv, const HashKey& itemKey)
+{
+    KmkvItem<Allocator>* item = GetKmkvItemOfType(kmkv, itemKey, KmkvItemType::STRING);
+    return item == nullptr ? nullptr : item->dynamicStringPtr;
 }
 
 template <typename Allocator>
@@ -77,131 +85,960 @@ const DynamicArray<char, Allocator>* GetKmkvItemStrValue(
     return GetKmkvItemStrValue(const_cast<HashTable<KmkvItem<Allocator>>&>(kmkv), itemKey);
 }
 
+template <typename Allocator>
+DynamicArray<char, Allocator>* GetKmkvItemStrValue(HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                   const HashedKey& itemKey)
+{
+    KmkvItem<Allocator>* item = GetKmkvItemOfType(kmkv, itemKey, KmkvItemType::STRING);
+    return item == nullptr ? nullptr : item->dynamicStringPtr;
+}
+
+template <typename Allocator>
+const DynamicArray<char, Allocator>* GetKmkvItemStrValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                         const HashedKey& itemKey)
+{
+    return GetKmkvItemStrValue(const_cast<HashTable<KmkvItem<Allocator>>&>(kmkv), itemKey);
+}
+
 template <typename Allocator>
 HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(
                                                     HashTable<KmkvItem<Allocator>, Allocator>& kmkv, const HashKey& itemKey)
 {
-    const KmkvItem<Allocator>* itemValuePtr = kmkv.GetValue(itemKey);
-    if (itemValuePtr == nullptr) {
-        return nullptr;
+    KmkvItem<Allocator>* item = GetKmkvItemOfType(kmkv, itemKey, KmkvItemType::KMKV);
+    return item == nullptr ? nullptr : item->hashTablePtr;
+}
+
+template <typename Allocator>
+const HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                          const HashKey& itemKey)
+{
+    return GetKmkvItemObjValue(const_cast<HashTable<KmkvItem<Allocator>>&>(kmkv), itemKey);
+}
+
+template <typename Allocator>
+HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                    const HashedKey& itemKey)
+{
+    KmkvItem<Allocator>* item = GetKmkvItemOfType(kmkv, itemKey, KmkvItemType::KMKV);
+    return item == nullptr ? nullptr : item->hashTablePtr;
+}
+
+template <typename Allocator>
+const HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                          const HashedKey& itemKey)
+{
+    return GetKmkvItemObjValue(const_cast<HashTable<KmkvItem<Allocator>>&>(kmkv), itemKey);
+}
+
+// Index of the next '\n' or '\r' (or '{' too, with BRACKET) at or after start, str.size if there is none
+template <bool BRACKET>
+internal uint32 FindKmkvDelimiter(const_string str, uint32 start)
+{
+    uint32 i = start;
+#if KM_SIMD_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i bracket = _mm_set1_epi8('{');
+    for (; str.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(str.data + i));
+        __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(chars, newline), _mm_cmpeq_epi8(chars, carriageReturn));
+        if (BRACKET) {
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, bracket));
+        }
+        const uint32 mask = (uint32)_mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return i + CountTrailingZeros32(mask);
+        }
+    }
+#endif
+
+    for (; i < str.size; i++) {
+        if (IsNewline(str[i]) || (BRACKET && str[i] == '{')) {
+            break;
+        }
+    }
+    return i;
+}
+
+int ReadNextKeywordValue(const_string str, string* outKeyword, string* outValue)
+{
+    if (str.size == 0 || str[0] == '\0') {
+        return 0;
+    }
+
+    int i = (int)FindWhitespace(str);
+    outKeyword->size = i;
+    outKeyword->data = (char*)str.data;
+    if (outKeyword->size == 0) {
+        return -1;
+    }
+
+    while (i < (int)str.size && str[i] == ' ') {
+        i++;
+    }
+
+    outValue->data = (char*)str.data + i;
+    if (i < (int)str.size && str[i] == '{') {
+        // Bracket value, ends at the matching '}' that starts a line
+        i++;
+        int bracketDepth = 1;
+        bool prevNewline = false;
+        bool bracketMatched = false;
+        // Gobble starting whitespace
+        while (i < (int)str.size && IsWhitespace(str[i])) {
+            prevNewline = prevNewline || IsNewline(str[i]);
+            i++;
+        }
+        outValue->data = (char*)str.data + i;
+
+        while (i < (int)str.size) {
+            if (!prevNewline) {
+                // Until the next newline, only a '{' can matter
+                i = (int)FindKmkvDelimiter<true>(str, i);
+                if (i == (int)str.size) {
+                    break;
+                }
+            }
+
+            if (str[i] == '{' && (i + 1 < (int)str.size) && IsNewline(str[i + 1])) {
+                bracketDepth++;
+            }
+            else if (str[i] == '}' && prevNewline) {
+                bracketDepth--;
+                if (bracketDepth == 0) {
+                    bracketMatched = true;
+                    break;
+                }
+            }
+            if (IsNewline(str[i])) {
+                prevNewline = true;
+            }
+            else if (prevNewline && !IsWhitespace(str[i])) {
+                prevNewline = false;
+            }
+            i++;
+        }
+
+        if (!bracketMatched) {
+            LOG_ERROR("Value bracket unmatched pair for keyword %.*s\n",
+                      (int)outKeyword->size, outKeyword->data);
+            return -1;
+        }
+        outValue->size = (uint32)(str.data + i - outValue->data);
+        i++;
+    }
+    else {
+        // Inline value, ends at the newline
+        i = (int)FindKmkvDelimiter<false>(str, i);
+        outValue->size = (uint32)(str.data + i - outValue->data);
+        if (i < (int)str.size) {
+            i++;
+        }
+    }
+
+    // Trim trailing whitespace
+    while (outValue->size > 0 && IsWhitespace((*outValue)[outValue->size - 1])) {
+        outValue->size--;
+    }
+
+    return (int)SkipWhitespace(str, i);
+}
+
+template <uint32 KEYWORD_SIZE, typename Allocator>
+int ReadNextKeywordValue(const Array<char>& str,
+                         FixedArray<char, KEYWORD_SIZE>* outKeyword, DynamicArray<char, Allocator>* outValue)
+{
+    string keyword, value;
+    int result = ReadNextKeywordValue(str, &keyword, &value);
+    if (result > 0) {
+        outKeyword->FromArray(keyword);
+        outValue->FromArray(value);
+    }
+    return result;
+}
+
+// Splits "keyword{tag}" into keyword and tag, tag is empty if there isn't one
+internal bool SplitKmkvKeywordTag(const_string keyword, string* outKey, string* outTag)
+{
+    *outKey = ToNonConstString(keyword);
+    *outTag = string::empty;
+
+    const uint32 tagStart = keyword.FindFirst('{');
+    if (tagStart == keyword.size) {
+        return true;
+    }
+
+    const_string tag = keyword.SliceFrom(tagStart + 1);
+    const uint32 tagEnd = tag.FindFirst('}');
+    if (tagEnd == tag.size) {
+        LOG_ERROR("kmkv keyword tag unmatched bracket\n");
+        return false;
+    }
+    if (tagEnd != tag.size - 1) {
+        LOG_ERROR("found characters after kmkv keyword tag bracket, keyword %.*s\n",
+                  (int)keyword.size, keyword.data);
+        return false;
+    }
+
+    *outKey = ToNonConstString(keyword.SliceTo(tagStart));
+    *outTag = ToNonConstString(tag.SliceTo(tagEnd));
+    return true;
+}
+
+// With parseNested false, {kmkv} children are left for later: no children yet, raw block in strValue
+internal bool ParseKmkvInPlaceRecursive(const_string str, LinearAllocator* allocator, KmkvNode* outNode,
+                                        bool parseNested = true)
+{
+    outNode->type = KmkvItemType::KMKV;
+    outNode->firstChild = nullptr;
+    outNode->numChildren = 0;
+
+    KmkvNode** tail = &outNode->firstChild;
+    Array<const char> remaining = str;
+    while (true) {
+        string keyword, value;
+        const int read = ReadNextKeywordValue(remaining, &keyword, &value);
+        if (read < 0) {
+            LOG_ERROR("kmkv file keyword/value error\n");
+            return false;
+        }
+        else if (read == 0) {
+            break;
+        }
+        remaining = remaining.SliceFrom(read);
+
+        KmkvNode* node = allocator->New<KmkvNode>();
+        if (node == nullptr) {
+            LOG_ERROR("kmkv out of memory, %d nodes parsed\n", outNode->numChildren);
+            return false;
+        }
+        if (!SplitKmkvKeywordTag(keyword, &node->key, &node->keywordTag)) {
+            return false;
+        }
+        node->keyHash = KeyHash((const_string)node->key);
+        node->next = nullptr;
+
+        if (StringEquals(node->keywordTag, ToString("kmkv"))) {
+            if (parseNested) {
+                if (!ParseKmkvInPlaceRecursive(value, allocator, node)) {
+                    return false;
+                }
+            }
+            else {
+                node->type = KmkvItemType::KMKV;
+                node->strValue = value;
+                node->firstChild = nullptr;
+                node->numChildren = 0;
+            }
+        }
+        else {
+            node->type = KmkvItemType::STRING;
+            node->strValue = value;
+            node->firstChild = nullptr;
+            node->numChildren = 0;
+        }
+
+        *tail = node;
+        tail = &node->next;
+        outNode->numChildren++;
+    }
+
+    return true;
+}
+
+bool ParseKmkvInPlace(const_string kmkvString, LinearAllocator* allocator, KmkvNode* outRoot)
+{
+    outRoot->key = string::empty;
+    outRoot->keywordTag = string::empty;
+    outRoot->keyHash = 0;
+    outRoot->strValue = string::empty;
+    outRoot->next = nullptr;
+    // ReadNextKeywordValue expects to start on a keyword
+    return ParseKmkvInPlaceRecursive(kmkvString.SliceFrom(SkipWhitespace(kmkvString)), allocator, outRoot);
+}
+
+bool BeginParseKmkvParallel(const_string kmkvString, LinearAllocator* allocator, KmkvNode* outRoot,
+                            KmkvParallelParser* outParser)
+{
+    outRoot->key = string::empty;
+    outRoot->keywordTag = string::empty;
+    outRoot->keyHash = 0;
+    outRoot->strValue = string::empty;
+    outRoot->next = nullptr;
+    if (!ParseKmkvInPlaceRecursive(kmkvString.SliceFrom(SkipWhitespace(kmkvString)), allocator, outRoot, false)) {
+        return false;
+    }
+
+    uint32 numBlocks = 0;
+    for (const KmkvNode* node = outRoot->firstChild; node != nullptr; node = node->next) {
+        numBlocks += node->type == KmkvItemType::KMKV;
+    }
+
+    outParser->blocks = allocator->NewArray<KmkvNode*>(numBlocks);
+    if (numBlocks > 0 && outParser->blocks.data == nullptr) {
+        LOG_ERROR("kmkv out of memory for %d parallel blocks\n", numBlocks);
+        return false;
+    }
+    uint32 i = 0;
+    for (KmkvNode* node = outRoot->firstChild; node != nullptr; node = node->next) {
+        if (node->type == KmkvItemType::KMKV) {
+            outParser->blocks[i++] = node;
+        }
     }
-    if (itemValuePtr->type != KmkvItemType::KMKV) {
+
+    outParser->nextBlock = 0;
+    outParser->failed = 0;
+    return true;
+}
+
+void ParseKmkvParallelWork(KmkvParallelParser* parser, LinearAllocator* threadAllocator)
+{
+    while (true) {
+        const uint32 blockIndex = AtomicFetchIncrement(&parser->nextBlock);
+        if (blockIndex >= parser->blocks.size) {
+            break;
+        }
+
+        KmkvNode* block = parser->blocks[blockIndex];
+        const string blockString = block->strValue;
+        block->strValue = string::empty;
+        if (!ParseKmkvInPlaceRecursive(blockString, threadAllocator, block)) {
+            LOG_ERROR("Failed to parse kmkv block %.*s\n", (int)block->key.size, block->key.data);
+            AtomicStore(&parser->failed, 1);
+        }
+    }
+}
+
+bool EndParseKmkvParallel(KmkvParallelParser* parser)
+{
+    return AtomicLoad(&parser->failed) == 0;
+}
+
+const KmkvNode* GetKmkvNode(const KmkvNode& kmkv, const_string itemKey)
+{
+    return GetKmkvNode(kmkv, HashedKey {
+        .data = itemKey.data,
+        .size = itemKey.size,
+        .hash = KeyHash(itemKey)
+    });
+}
+
+const KmkvNode* GetKmkvNode(const KmkvNode& kmkv, const HashedKey& itemKey)
+{
+    for (const KmkvNode* child = kmkv.firstChild; child != nullptr; child = child->next) {
+        if (child->keyHash == itemKey.hash && KeyCompare((const_string)child->key, itemKey)) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+const string* GetKmkvItemStrValue(const KmkvNode& kmkv, const_string itemKey)
+{
+    const KmkvNode* node = GetKmkvNode(kmkv, itemKey);
+    return node == nullptr || node->type != KmkvItemType::STRING ? nullptr : &node->strValue;
+}
+
+const string* GetKmkvItemStrValue(const KmkvNode& kmkv, const HashedKey& itemKey)
+{
+    const KmkvNode* node = GetKmkvNode(kmkv, itemKey);
+    return node == nullptr || node->type != KmkvItemType::STRING ? nullptr : &node->strValue;
+}
+
+const KmkvNode* GetKmkvItemObjValue(const KmkvNode& kmkv, const_string itemKey)
+{
+    const KmkvNode* node = GetKmkvNode(kmkv, itemKey);
+    return node == nullptr || node->type != KmkvItemType::KMKV ? nullptr : node;
+}
+
+const KmkvNode* GetKmkvItemObjValue(const KmkvNode& kmkv, const HashedKey& itemKey)
+{
+    const KmkvNode* node = GetKmkvNode(kmkv, itemKey);
+    return node == nullptr || node->type != KmkvItemType::KMKV ? nullptr : node;
+}
+
+bool CompileKmkvPath(const_string path, KmkvPath* outPath)
+{
+    outPath->depth = 0;
+
+    SplitIterator it(path, '.');
+    string key;
+    while (it.Next(&key)) {
+        if (key.size == 0) {
+            LOG_ERROR("kmkv path has an empty key: %.*s\n", (int)path.size, path.data);
+            return false;
+        }
+        if (outPath->depth == KMKV_PATH_MAX_DEPTH) {
+            LOG_ERROR("kmkv path deeper than %d: %.*s\n", KMKV_PATH_MAX_DEPTH, (int)path.size, path.data);
+            return false;
+        }
+
+        outPath->keys[outPath->depth++] = HashedKey {
+            .data = key.data,
+            .size = key.size,
+            .hash = KeyHash((const_string)key)
+        };
+    }
+
+    if (outPath->depth == 0) {
+        LOG_ERROR("empty kmkv path\n");
+        return false;
+    }
+    return true;
+}
+
+const KmkvNode* GetKmkvNode(const KmkvNode& kmkv, const KmkvPath& path)
+{
+    const KmkvNode* node = &kmkv;
+    for (uint32 i = 0; i < path.depth; i++) {
+        if (node->type != KmkvItemType::KMKV) {
+            return nullptr;
+        }
+        node = GetKmkvNode(*node, path.keys[i]);
+        if (node == nullptr) {
+            return nullptr;
+        }
+    }
+    return node;
+}
+
+const string* GetKmkvItemStrValue(const KmkvNode& kmkv, const KmkvPath& path)
+{
+    const KmkvNode* node = GetKmkvNode(kmkv, path);
+    return node == nullptr || node->type != KmkvItemType::STRING ? nullptr : &node->strValue;
+}
+
+const KmkvNode* GetKmkvItemObjValue(const KmkvNode& kmkv, const KmkvPath& path)
+{
+    const KmkvNode* node = GetKmkvNode(kmkv, path);
+    return node == nullptr || node->type != KmkvItemType::KMKV ? nullptr : node;
+}
+
+internal bool ParseKmkvFloats(const_string str, float32* outFloats, uint32 count)
+{
+    uint32 start = SkipWhitespace(str);
+    for (uint32 i = 0; i < count; i++) {
+        const uint32 end = FindWhitespace(str, start);
+        if (end == start || !StringToFloat32(str.Slice(start, end), &outFloats[i])) {
+            return false;
+        }
+        start = SkipWhitespace(str, end);
+    }
+    return start == str.size;
+}
+
+internal bool LoadKmkvField(const KmkvNode& node, const KmkvField& field, void* outStruct)
+{
+    void* fieldPtr = (uint8*)outStruct + field.offset;
+    if (field.type == KmkvFieldType::OBJECT) {
+        if (node.type != KmkvItemType::KMKV) {
+            LOG_ERROR("kmkv item %.*s should be an object\n", (int)node.key.size, node.key.data);
+            return false;
+        }
+        DEBUG_ASSERT(field.binding != nullptr);
+        return LoadKmkvStruct(node, *field.binding, fieldPtr);
+    }
+
+    if (node.type != KmkvItemType::STRING) {
+        LOG_ERROR("kmkv item %.*s should be a string\n", (int)node.key.size, node.key.data);
+        return false;
+    }
+
+    if (field.type == KmkvFieldType::STRING) {
+        *(string*)fieldPtr = node.strValue;
+        return true;
+    }
+
+    const_string value = TrimWhitespace(node.strValue);
+    bool success = false;
+    switch (field.type) {
+        case KmkvFieldType::BOOL: {
+            const bool isTrue = StringEquals(value, ToString("true"));
+            success = isTrue || StringEquals(value, ToString("false"));
+            *(bool*)fieldPtr = isTrue;
+        } break;
+        case KmkvFieldType::INT32: {
+            success = StringToIntBase10(value, (int32*)fieldPtr);
+        } break;
+        case KmkvFieldType::UINT32: {
+            success = StringToUInt32Base10(value, (uint32*)fieldPtr);
+        } break;
+        case KmkvFieldType::INT64: {
+            success = StringToInt64Base10(value, (int64*)fieldPtr);
+        } break;
+        case KmkvFieldType::UINT64: {
+            success = StringToUInt64Base10(value, (uint64*)fieldPtr);
+        } break;
+        case KmkvFieldType::FLOAT32: {
+            success = StringToFloat32(value, (float32*)fieldPtr);
+        } break;
+        case KmkvFieldType::FLOAT64: {
+            success = StringToFloat64(value, (float64*)fieldPtr);
+        } break;
+        case KmkvFieldType::VEC2: {
+            success = ParseKmkvFloats(value, ((Vec2*)fieldPtr)->e, 2);
+        } break;
+        case KmkvFieldType::VEC3: {
+            success = ParseKmkvFloats(value, ((Vec3*)fieldPtr)->e, 3);
+        } break;
+        case KmkvFieldType::VEC4: {
+            success = ParseKmkvFloats(value, ((Vec4*)fieldPtr)->e, 4);
+        } break;
+        default: {
+            DEBUG_PANIC("Unhandled kmkv field type %d\n", field.type);
+        } break;
+    }
+
+    if (!success) {
+        LOG_ERROR("failed to parse kmkv item %.*s, value %.*s\n", (int)node.key.size, node.key.data,
+                  (int)value.size, value.data);
+    }
+    return success;
+}
+
+bool LoadKmkvStruct(const KmkvNode& kmkv, const KmkvBinding& binding, void* outStruct)
+{
+    DEBUG_ASSERT(kmkv.type == KmkvItemType::KMKV);
+
+    for (const KmkvNode* child = kmkv.firstChild; child != nullptr; child = child->next) {
+        for (uint32 i = 0; i < binding.fields.size; i++) {
+            const KmkvField& field = binding.fields[i];
+            if (field.key.hash == child->keyHash && KeyCompare((const_string)child->key, field.key)) {
+                if (!LoadKmkvField(*child, field, outStruct)) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Appends numBytes zeroes, returns their offset in outOffset
+template <typename Allocator>
+internal bool KmkvBinaryReserve(DynamicArray<uint8, Allocator>* outBinary, uint32 numBytes, uint32* outOffset)
+{
+    const uint32 offset = outBinary->size;
+    if (outBinary->capacity - outBinary->size < numBytes) {
+        const uint32 doubleCapacity = outBinary->capacity * 2;
+        const uint32 minCapacity = outBinary->size + numBytes;
+        if (!outBinary->UpdateCapacity(doubleCapacity > minCapacity ? doubleCapacity : minCapacity)) {
+            LOG_ERROR("KmkvToBinary out of memory, %d bytes written\n", outBinary->size);
+            return false;
+        }
+    }
+
+    MemSet(outBinary->data + offset, 0, numBytes);
+    outBinary->size += numBytes;
+    *outOffset = offset;
+    return true;
+}
+
+template <typename Allocator>
+internal bool KmkvBinaryAppendString(DynamicArray<uint8, Allocator>* outBinary, const_string str, uint32* outOffset)
+{
+    if (!KmkvBinaryReserve(outBinary, str.size + 1, outOffset)) {
+        return false;
+    }
+    if (str.size > 0) {
+        MemCopy(outBinary->data + *outOffset, str.data, str.size);
+    }
+    return true;
+}
+
+template <typename Allocator>
+internal bool KmkvToBinaryRecursive(const KmkvNode& kmkv, DynamicArray<uint8, Allocator>* outBinary,
+                                    uint32* outOffset)
+{
+    uint32 paddingOffset;
+    if (!KmkvBinaryReserve(outBinary, (4 - outBinary->size % 4) % 4, &paddingOffset)) {
+        return false;
+    }
+
+    // At most half full, so probes stay short
+    uint32 indexCapacity = 1;
+    while (indexCapacity < kmkv.numChildren * 2) {
+        indexCapacity *= 2;
+    }
+
+    uint32 objectOffset;
+    if (!KmkvBinaryReserve(outBinary, sizeof(KmkvBinaryObjectHeader)
+                           + kmkv.numChildren * sizeof(KmkvBinaryItem)
+                           + indexCapacity * sizeof(uint32), &objectOffset)) {
+        return false;
+    }
+    const uint32 itemsOffset = objectOffset + sizeof(KmkvBinaryObjectHeader);
+    const uint32 indexOffset = itemsOffset + kmkv.numChildren * sizeof(KmkvBinaryItem);
+    const KmkvBinaryObjectHeader header = {
+        .numItems = kmkv.numChildren,
+        .indexCapacity = indexCapacity
+    };
+    MemCopy(outBinary->data + objectOffset, &header, sizeof(header));
+
+    uint32 i = 0;
+    for (const KmkvNode* child = kmkv.firstChild; child != nullptr; child = child->next, i++) {
+        KmkvBinaryItem item = {};
+        item.keyHash = child->keyHash;
+        item.keySize = child->key.size;
+        item.tagSize = child->keywordTag.size;
+        item.type = (uint32)child->type;
+        if (!KmkvBinaryAppendString(outBinary, child->key, &item.keyOffset)
+            || !KmkvBinaryAppendString(outBinary, child->keywordTag, &item.tagOffset)) {
+            return false;
+        }
+        if (child->type == KmkvItemType::KMKV) {
+            if (!KmkvToBinaryRecursive(*child, outBinary, &item.valueOffset)) {
+                return false;
+            }
+        }
+        else {
+            if (!KmkvBinaryAppendString(outBinary, child->strValue, &item.valueOffset)) {
+                return false;
+            }
+            item.valueSize = child->strValue.size;
+        }
+
+        // outBinary may have been reallocated, so only go through offsets
+        MemCopy(outBinary->data + itemsOffset + i * sizeof(KmkvBinaryItem), &item, sizeof(item));
+
+        // Duplicate keys probe past earlier ones, so lookups find the first, same as GetKmkvNode
+        uint32* index = (uint32*)(outBinary->data + indexOffset);
+        uint32 slot = item.keyHash & (indexCapacity - 1);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (indexCapacity - 1);
+        }
+        index[slot] = i + 1;
+    }
+
+    *outOffset = objectOffset;
+    return true;
+}
+
+template <typename Allocator>
+bool KmkvToBinary(const KmkvNode& kmkv, DynamicArray<uint8, Allocator>* outBinary)
+{
+    outBinary->Clear();
+    uint32 headerOffset, rootOffset;
+    if (!KmkvBinaryReserve(outBinary, sizeof(KmkvBinaryHeader), &headerOffset)
+        || !KmkvToBinaryRecursive(kmkv, outBinary, &rootOffset)) {
+        return false;
+    }
+
+    const KmkvBinaryHeader header = {
+        .magic = KMKV_BINARY_MAGIC,
+        .version = KMKV_BINARY_VERSION,
+        .size = outBinary->size,
+        .rootOffset = rootOffset
+    };
+    MemCopy(outBinary->data + headerOffset, &header, sizeof(header));
+    return true;
+}
+
+bool LoadKmkvBinary(const Array<const uint8>& data, KmkvBinaryObject* outRoot)
+{
+    if (data.size < sizeof(KmkvBinaryHeader)) {
+        LOG_ERROR("Binary kmkv too small, %d bytes\n", data.size);
+        return false;
+    }
+
+    const KmkvBinaryHeader* header = (const KmkvBinaryHeader*)data.data;
+    if (header->magic != KMKV_BINARY_MAGIC) {
+        LOG_ERROR("Binary kmkv bad magic number %x\n", header->magic);
+        return false;
+    }
+    if (header->version != KMKV_BINARY_VERSION) {
+        LOG_ERROR("Binary kmkv version %d, expected %d\n", header->version, KMKV_BINARY_VERSION);
+        return false;
+    }
+    if (header->size != data.size || header->rootOffset > data.size - sizeof(KmkvBinaryObjectHeader)) {
+        LOG_ERROR("Binary kmkv size mismatch, header %d, data %d\n", header->size, data.size);
+        return false;
+    }
+
+    outRoot->data = data;
+    outRoot->offset = header->rootOffset;
+    return true;
+}
+
+internal const KmkvBinaryItem* GetKmkvBinaryItem(const KmkvBinaryObject& kmkv, const HashedKey& itemKey)
+{
+    const Array<const uint8>& data = kmkv.data;
+    const KmkvBinaryObjectHeader* header = (const KmkvBinaryObjectHeader*)(data.data + kmkv.offset);
+    const uint64 objectEnd = (uint64)kmkv.offset + sizeof(KmkvBinaryObjectHeader)
+        + (uint64)header->numItems * sizeof(KmkvBinaryItem) + (uint64)header->indexCapacity * sizeof(uint32);
+    if (objectEnd > data.size) {
+        LOG_ERROR("Binary kmkv object at %d out of bounds\n", kmkv.offset);
         return nullptr;
     }
-    return itemValuePtr->hashTablePtr;
+
+    const KmkvBinaryItem* items = (const KmkvBinaryItem*)(header + 1);
+    const uint32* index = (const uint32*)(items + header->numItems);
+    const uint32 mask = header->indexCapacity - 1;
+    uint32 slot = itemKey.hash & mask;
+    for (uint32 probes = 0; probes < header->indexCapacity; probes++) {
+        const uint32 itemIndex = index[slot];
+        if (itemIndex == 0 || itemIndex > header->numItems) {
+            return nullptr;
+        }
+
+        const KmkvBinaryItem* item = &items[itemIndex - 1];
+        if (item->keyHash == itemKey.hash && item->keySize == itemKey.size
+            && (uint64)item->keyOffset + item->keySize <= data.size
+            && MemComp(data.data + item->keyOffset, itemKey.data, itemKey.size) == 0) {
+            return item;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return nullptr;
 }
 
-template <typename Allocator>
-const DynamicArray<char, Allocator>* GetKmkvItemObjValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
-                                                         const HashKey& itemKey)
+bool GetKmkvItemStrValue(const KmkvBinaryObject& kmkv, const_string itemKey, Array<const char>* outValue)
+{
+    return GetKmkvItemStrValue(kmkv, HashedKey {
+        .data = itemKey.data,
+        .size = itemKey.size,
+        .hash = KeyHash(itemKey)
+    }, outValue);
+}
+
+bool GetKmkvItemStrValue(const KmkvBinaryObject& kmkv, const HashedKey& itemKey, Array<const char>* outValue)
+{
+    const KmkvBinaryItem* item = GetKmkvBinaryItem(kmkv, itemKey);
+    if (item == nullptr || item->type != (uint32)KmkvItemType::STRING
+        || (uint64)item->valueOffset + item->valueSize > kmkv.data.size) {
+        return false;
+    }
+
+    outValue->size = item->valueSize;
+    outValue->data = (const char*)kmkv.data.data + item->valueOffset;
+    return true;
+}
+
+bool GetKmkvItemObjValue(const KmkvBinaryObject& kmkv, const_string itemKey, KmkvBinaryObject* outValue)
+{
+    return GetKmkvItemObjValue(kmkv, HashedKey {
+        .data = itemKey.data,
+        .size = itemKey.size,
+        .hash = KeyHash(itemKey)
+    }, outValue);
+}
+
+bool GetKmkvItemObjValue(const KmkvBinaryObject& kmkv, const HashedKey& itemKey, KmkvBinaryObject* outValue)
+{
+    const KmkvBinaryItem* item = GetKmkvBinaryItem(kmkv, itemKey);
+    if (item == nullptr || item->type != (uint32)KmkvItemType::KMKV
+        || item->valueOffset > kmkv.data.size - sizeof(KmkvBinaryObjectHeader)) {
+        return false;
+    }
+
+    outValue->data = kmkv.data;
+    outValue->offset = item->valueOffset;
+    return true;
+}
+
+enum class KmkvStreamItemType
+{
+    NONE, // only whitespace
+    STRING,
+    BEGIN_OBJECT,
+    END_OBJECT
+};
+
+struct KmkvStreamItem
+{
+    KmkvStreamItemType type;
+    string key;
+    string keywordTag;
+    string value;
+};
+
+enum class KmkvStreamScanResult
 {
-    return GetKmkvItemObjValue(const_cast<HashTable<KmkvItem<Allocator>>&>(kmkv), itemKey);
-}
+    ITEM,
+    NEED_MORE,
+    ERROR
+};
 
-int ReadNextKeywordValue(const_string str, string* outKeyword, string* outValue)
+// Same rules as ReadNextKeywordValue, but {kmkv} values aren't read in full: the item is just the
+// opening bracket, and the closing one comes later as its own END_OBJECT item.
+internal KmkvStreamScanResult ScanKmkvStreamItem(const_string window, bool eof, uint32 depth,
+                                                 KmkvStreamItem* outItem, uint32* outConsumed)
 {
-    if (str.size == 0 || str[0] == '\0') {
-        return 0;
+    const uint32 keywordStart = SkipWhitespace(window);
+    if (keywordStart == window.size) {
+        outItem->type = KmkvStreamItemType::NONE;
+        *outConsumed = window.size;
+        return KmkvStreamScanResult::ITEM;
+    }
+    if (window[keywordStart] == '}' && depth > 0) {
+        outItem->type = KmkvStreamItemType::END_OBJECT;
+        *outConsumed = keywordStart + 1;
+        return KmkvStreamScanResult::ITEM;
     }
 
-    int i = 0;
-    outKeyword->size = 0;
-    outKeyword->data = (char*)str.data;
-    while (i < (int)str.size && !IsWhitespace(str[i])) {
-        outKeyword->size++;
-        i++;
+    const uint32 keywordEnd = FindWhitespace(window, keywordStart);
+    if (keywordEnd == window.size && !eof) {
+        return KmkvStreamScanResult::NEED_MORE;
     }
-    if (outKeyword->size == 0) {
-        return -1;
+    if (!SplitKmkvKeywordTag(window.Slice(keywordStart, keywordEnd), &outItem->key, &outItem->keywordTag)) {
+        return KmkvStreamScanResult::ERROR;
     }
 
-    while (i < (int)str.size && str[i] == ' ') {
+    uint32 i = keywordEnd;
+    while (i < window.size && window[i] == ' ') {
         i++;
     }
+    if (i == window.size && !eof) {
+        return KmkvStreamScanResult::NEED_MORE;
+    }
 
-    outValue->size = 0;
-    outValue->data = (char*)str.data + i;
-    bool bracketValue = false;
-    while (i < (int)str.size) {
-        if (IsNewline(str[i])) {
-            // End of inline value
-            i++;
-            break;
-        }
-        if (str[i] == '{' && outValue->size == 0) {
-            // Start of bracket value, read in separately
-            i++;
-            bracketValue = true;
-            break;
-        }
-
-        outValue->size++;
+    uint32 valueStart = i;
+    uint32 valueEnd;
+    if (i < window.size && window[i] == '{') {
         i++;
-    }
+        if (StringEquals(outItem->keywordTag, ToString("kmkv"))) {
+            outItem->type = KmkvStreamItemType::BEGIN_OBJECT;
+            *outConsumed = i;
+            return KmkvStreamScanResult::ITEM;
+        }
 
-    if (bracketValue) {
+        valueStart = i;
         int bracketDepth = 1;
         bool prevNewline = false;
         bool bracketMatched = false;
-        while (i < (int)str.size) {
-            if (str[i] == '{' && (i + 1 < (int)str.size) && IsNewline(str[i + 1])) {
-                bracketDepth++;
+        for (; i < window.size; i++) {
+            const char c = window[i];
+            if (c == '{') {
+                if (i + 1 == window.size && !eof) {
+                    return KmkvStreamScanResult::NEED_MORE;
+                }
+                if (i + 1 < window.size && IsNewline(window[i + 1])) {
+                    bracketDepth++;
+                }
             }
-            else if (str[i] == '}' && prevNewline) {
+            else if (c == '}' && prevNewline) {
                 bracketDepth--;
                 if (bracketDepth == 0) {
-                    i++;
                     bracketMatched = true;
                     break;
                 }
             }
-            if (IsNewline(str[i])) {
+            if (IsNewline(c)) {
                 prevNewline = true;
             }
-            else if (prevNewline && !IsWhitespace(str[i])) {
+            else if (prevNewline && !IsWhitespace(c)) {
                 prevNewline = false;
             }
-            if (outValue->size == 0 && IsWhitespace(str[i])) {
+            if (valueStart == i && IsWhitespace(c)) {
                 // Gobble starting whitespace
-                i++;
-                outValue->data = (char*)str.data + i;
-                continue;
+                valueStart++;
             }
-
-            outValue->size++;
-            i++;
         }
-
         if (!bracketMatched) {
+            if (!eof) {
+                return KmkvStreamScanResult::NEED_MORE;
+            }
             LOG_ERROR("Value bracket unmatched pair for keyword %.*s\n",
-                      (int)outKeyword->size, outKeyword->data);
-            return -1;
+                      (int)outItem->key.size, outItem->key.data);
+            return KmkvStreamScanResult::ERROR;
         }
+        valueEnd = i;
+        i++;
     }
-
-    // Trim trailing whitespace
-    while (outValue->size > 0 && IsWhitespace((*outValue)[outValue->size - 1])) {
-        outValue->size--;
+    else {
+        while (i < window.size && !IsNewline(window[i])) {
+            i++;
+        }
+        if (i == window.size && !eof) {
+            return KmkvStreamScanResult::NEED_MORE;
+        }
+        valueEnd = i;
+        if (i < window.size) {
+            i++;
+        }
     }
 
-    while (i < (int)str.size && IsWhitespace(str[i])) {
-        i++;
+    while (valueEnd > valueStart && IsWhitespace(window[valueEnd - 1])) {
+        valueEnd--;
     }
-
-    return i;
+    outItem->type = KmkvStreamItemType::STRING;
+    outItem->value = ToNonConstString(window.Slice(valueStart, valueEnd));
+    *outConsumed = i;
+    return KmkvStreamScanResult::ITEM;
 }
 
-template <uint64 KEYWORD_SIZE, typename Allocator>
-int ReadNextKeywordValue(const Array<char>& str,
-                         FixedArray<char, KEYWORD_SIZE>* outKeyword, DynamicArray<char, Allocator>* outValue)
+template <typename Handler>
+bool ReadKmkvStream(KmkvStreamReadCallback readCallback, void* userData, Array<char> buffer, Handler* handler)
 {
-    string keyword, value;
-    int result = ReadNextKeywordValue(str, &keyword, &value);
-    if (result > 0) {
-        outKeyword->FromArray(keyword);
-        outValue->FromArray(value);
+    // Unconsumed input is buffer[start, end)
+    uint32 start = 0;
+    uint32 end = 0;
+    bool eof = false;
+    uint32 depth = 0;
+    while (true) {
+        const_string window = { .size = end - start, .data = buffer.data + start };
+        KmkvStreamItem item;
+        uint32 consumed;
+        KmkvStreamScanResult result = KmkvStreamScanResult::NEED_MORE;
+        if (window.size > 0 || eof) {
+            result = ScanKmkvStreamItem(window, eof, depth, &item, &consumed);
+        }
+
+        if (result == KmkvStreamScanResult::ERROR) {
+            LOG_ERROR("kmkv stream keyword/value error\n");
+            return false;
+        }
+        if (result == KmkvStreamScanResult::NEED_MORE) {
+            if (start == 0 && end == buffer.size) {
+                LOG_ERROR("kmkv stream item larger than the %d byte buffer\n", buffer.size);
+                return false;
+            }
+
+            MemMove(buffer.data, buffer.data + start, end - start);
+            end -= start;
+            start = 0;
+            const int read = readCallback(buffer.data + end, buffer.size - end, userData);
+            if (read < 0) {
+                LOG_ERROR("kmkv stream read error\n");
+                return false;
+            }
+            eof = read == 0;
+            end += (uint32)read;
+            continue;
+        }
+
+        start += consumed;
+        switch (item.type) {
+            case KmkvStreamItemType::NONE: {
+                if (eof) {
+                    if (depth > 0) {
+                        LOG_ERROR("kmkv stream ended inside %d objects\n", depth);
+                        return false;
+                    }
+                    return true;
+                }
+            } break;
+            case KmkvStreamItemType::STRING: {
+                if (!handler->OnKey(item.key, item.keywordTag) || !handler->OnString(item.value)) {
+                    return false;
+                }
+            } break;
+            case KmkvStreamItemType::BEGIN_OBJECT: {
+                if (!handler->OnKey(item.key, item.keywordTag) || !handler->OnBeginObject()) {
+                    return false;
+                }
+                depth++;
+            } break;
+            case KmkvStreamItemType::END_OBJECT: {
+                if (!handler->OnEndObject()) {
+                    return false;
+                }
+                depth--;
+            } break;
+        }
     }
-    return result;
 }
 
 template <typename Allocator>
@@ -209,7 +1046,10 @@ internal bool LoadKmkvRecursive(string str, HashTable<KmkvItem<Allocator>, Alloc
 {
     const uint64 KEYWORD_MAX_LENGTH = 32;
     FixedArray<char, KEYWORD_MAX_LENGTH> keyword;
-    DynamicArray<char, Allocator> valueBuffer(outKmkv->allocator);
+    // Scratch on the default allocator. Freeing it from a LinearAllocator outKmkv->allocator would also
+    // free the nested tables allocated after it.
+    DynamicArray<char> valueBuffer;
+    defer(valueBuffer.Free());
     while (true) {
         int read = ReadNextKeywordValue(str, &keyword, &valueBuffer);
         if (read < 0) {
@@ -223,6 +1063,7 @@ internal bool LoadKmkvRecursive(string str, HashTable<KmkvItem<Allocator>, Alloc
         str.data += read;
 
         DynamicArray<char> keywordTag;
+        defer(keywordTag.Free());
         bool keywordHasTag = false;
         uint64 keywordTagInd = 0;
         while (keywordTagInd < keyword.size) {
@@ -263,6 +1104,8 @@ internal bool LoadKmkvRecursive(string str, HashTable<KmkvItem<Allocator>, Alloc
         }
         KmkvItem<Allocator>* newItem = outKmkv->Add(keywordArray);
         DEBUG_ASSERT(newItem);
+        // HashTable doesn't construct values, and keywordTag has to be valid before the assignment
+        new (newItem) KmkvItem<Allocator>();
         newItem->keywordTag = keywordTag;
 
         if (StringEquals(newItem->keywordTag.ToArray(), ToString("kmkv"))) {
@@ -319,53 +1162,304 @@ bool LoadKmkv(const Array<char>& kmkvString, HashTable<KmkvItem<Allocator>, Allo
 }
 
 template <typename Allocator>
-internal bool KmkvToStringRecursive(const HashTable<KmkvItem<Allocator>>& kmkv, int indentSpaces,
-                                    DynamicArray<char, Allocator>* outString)
+KmkvChangeset<Allocator>::KmkvChangeset(Allocator* allocator)
+: changes(allocator), pathChars(allocator)
+{
+}
+
+template <typename Allocator>
+const_string KmkvChangeset<Allocator>::GetPath(uint32 changeIndex) const
+{
+    DEBUG_ASSERT(changeIndex < changes.size);
+    const KmkvChange& change = changes[changeIndex];
+    return const_string { .size = change.pathSize, .data = pathChars.data + change.pathStart };
+}
+
+template <typename Allocator>
+bool KmkvChangeset<Allocator>::Affects(const_string path) const
+{
+    for (uint32 i = 0; i < changes.size; i++) {
+        const const_string changePath = GetPath(i);
+        const uint32 minSize = MinUInt32(changePath.size, path.size);
+        if (!StringEquals(changePath.SliceTo(minSize), path.SliceTo(minSize))) {
+            continue;
+        }
+        // Equal, or one is a parent of the other if the longer one continues with a separator
+        if (changePath.size == path.size) {
+            return true;
+        }
+        const char next = changePath.size > path.size ? changePath[minSize] : path[minSize];
+        if (next == '.') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <typename Allocator>
+void KmkvChangeset<Allocator>::Clear()
+{
+    changes.Clear();
+    pathChars.Clear();
+}
+
+template <typename Allocator>
+void KmkvChangeset<Allocator>::Initialize(Allocator* allocator)
+{
+    changes.Initialize(allocator);
+    pathChars.Initialize(allocator);
+}
+
+template <typename Allocator>
+void KmkvChangeset<Allocator>::Free()
+{
+    changes.Free();
+    pathChars.Free();
+}
+
+template <typename Allocator>
+internal void AddKmkvChange(KmkvChangeset<Allocator>* changeset, KmkvChangeType type,
+                            const_string parentPath, const_string key)
+{
+    KmkvChange* change = changeset->changes.Append();
+    change->type = type;
+    change->pathStart = changeset->pathChars.size;
+    changeset->pathChars.Append(parentPath);
+    if (parentPath.size > 0) {
+        changeset->pathChars.Append('.');
+    }
+    changeset->pathChars.Append(key);
+    change->pathSize = changeset->pathChars.size - change->pathStart;
+}
+
+// Moves src's contents into dst, which has to be unconstructed or destructed, and leaves src empty
+template <typename Allocator>
+internal void MoveKmkvItem(KmkvItem<Allocator>* dst, KmkvItem<Allocator>* src)
 {
-    for (uint32 i = 0; i < kmkv.capacity; i++) {
-        const HashKey& key = kmkv.pairs[i].key;
-        if (key.s.size == 0) {
+    MemCopy(dst, src, sizeof(KmkvItem<Allocator>));
+    new (src) KmkvItem<Allocator>();
+}
+
+// Diffs newKmkv into kmkv. Items are moved out of newKmkv when kmkv takes them over.
+// path holds the dotted path of the table being diffed.
+template <typename Allocator>
+internal void ReloadKmkvRecursive(HashTable<KmkvItem<Allocator>, Allocator>* kmkv,
+                                  HashTable<KmkvItem<Allocator>, Allocator>* newKmkv,
+                                  DynamicArray<char>* path, KmkvChangeset<Allocator>* changeset)
+{
+    // Remove moves the last pair into the removed one's place, so that index is visited again
+    uint32 i = 0;
+    while (i < kmkv->size) {
+        const HashKey key = kmkv->pairs[i].key;
+        if (newKmkv->GetValue(key) != nullptr) {
+            i++;
+            continue;
+        }
+
+        AddKmkvChange(changeset, KmkvChangeType::REMOVED, path->ToArray(), key.s.ToArray());
+        kmkv->pairs[i].value.~KmkvItem();
+        kmkv->Remove(key);
+    }
+
+    for (KeyValuePair<KmkvItem<Allocator>>& newPair : *newKmkv) {
+        const const_string key = newPair.key.s.ToArray();
+        KmkvItem<Allocator>* newItem = &newPair.value;
+        KmkvItem<Allocator>* item = kmkv->GetValue(newPair.key);
+        if (item == nullptr) {
+            AddKmkvChange(changeset, KmkvChangeType::ADDED, path->ToArray(), key);
+            item = kmkv->Add(newPair.key);
+            DEBUG_ASSERT(item);
+            MoveKmkvItem(item, newItem);
+            continue;
+        }
+
+        if (item->type != newItem->type
+            || !StringEquals(item->keywordTag.ToArray(), newItem->keywordTag.ToArray())) {
+            AddKmkvChange(changeset, KmkvChangeType::MODIFIED, path->ToArray(), key);
+            item->~KmkvItem();
+            MoveKmkvItem(item, newItem);
             continue;
         }
 
-        for (int j = 0; j < indentSpaces; j++) outString->Append(' ');
-        outString->Append(key.s.ToArray());
-        const KmkvItem<Allocator>& item = kmkv.pairs[i].value;
+        switch (item->type) {
+            case KmkvItemType::NONE: {
+            } break;
+            case KmkvItemType::STRING: {
+                const string newValue = newItem->dynamicStringPtr->ToArray();
+                if (!StringEquals(item->dynamicStringPtr->ToArray(), newValue)) {
+                    AddKmkvChange(changeset, KmkvChangeType::MODIFIED, path->ToArray(), key);
+                    item->dynamicStringPtr->FromArray(newValue);
+                }
+            } break;
+            case KmkvItemType::KMKV: {
+                const uint32 pathSize = path->size;
+                if (pathSize > 0) {
+                    path->Append('.');
+                }
+                path->Append(key);
+                ReloadKmkvRecursive(item->hashTablePtr, newItem->hashTablePtr, path, changeset);
+                path->size = pathSize;
+            } break;
+        }
+    }
+}
+
+template <typename Allocator>
+bool ReloadKmkv(const Array<char>& filePath, Allocator* allocator,
+                HashTable<KmkvItem<Allocator>>* kmkv, KmkvChangeset<Allocator>* outChangeset)
+{
+    Array<uint8> kmkvFile = LoadEntireFile(filePath, allocator);
+    if (kmkvFile.data == nullptr) {
+        LOG_ERROR("Failed to load file %.*s\n", (int)filePath.size, filePath.data);
+        return false;
+    }
+    defer(FreeFile(kmkvFile, allocator));
+
+    Array<char> fileString;
+    fileString.size = kmkvFile.size;
+    fileString.data = (char*)kmkvFile.data;
+
+    return ReloadKmkv(fileString, kmkv, outChangeset);
+}
+
+template <typename Allocator>
+bool ReloadKmkv(const Array<char>& kmkvString, HashTable<KmkvItem<Allocator>, Allocator>* kmkv,
+                KmkvChangeset<Allocator>* outChangeset)
+{
+    DEBUG_ASSERT(typeid(Allocator) == typeid(StandardAllocator));
+    outChangeset->Clear();
+
+    // Parse everything first, so a broken file doesn't leave kmkv half-updated
+    HashTable<KmkvItem<Allocator>, Allocator> newKmkv(kmkv->allocator);
+    if (!LoadKmkvRecursive(kmkvString, &newKmkv)) {
+        LOG_ERROR("kmkv reload failed to parse, keeping previous values\n");
+        return false;
+    }
+
+    DynamicArray<char> path;
+    defer(path.Free());
+    ReloadKmkvRecursive(kmkv, &newKmkv, &path, outChangeset);
+    return true;
+}
+
+/*
+Output for the serializers below. Room is made with one Reserve per item, sized from the item, and
+the Append calls after it write without capacity checks.
+*/
+template <typename Allocator>
+struct KmkvWriter
+{
+    DynamicArray<char, Allocator>* out;
+
+    bool Reserve(uint64 numChars)
+    {
+        if (out->capacity - out->size >= numChars) {
+            return true;
+        }
+
+        const uint64 minCapacity = out->size + numChars;
+        if (minCapacity > UINT32_MAX) {
+            LOG_ERROR("Serialized kmkv too large, over %llu bytes\n", (unsigned long long)minCapacity);
+            return false;
+        }
+        uint64 newCapacity = (uint64)out->capacity * 2;
+        if (newCapacity < minCapacity) {
+            newCapacity = minCapacity;
+        }
+        if (newCapacity > UINT32_MAX) {
+            newCapacity = UINT32_MAX;
+        }
+        return out->UpdateCapacity((uint32)newCapacity);
+    }
+
+    // Room for str once escaped, plus extra. Escaping makes a string at most 6 times longer (\u00XX),
+    // so short strings just reserve that. Long ones are counted, to not over-allocate by much.
+    bool ReserveEscapedJson(const_string str, uint32 extra)
+    {
+        const uint64 escapedSize = str.size < 1024 ? (uint64)str.size * 6 : JsonEscapedSize(str);
+        return Reserve(escapedSize + extra);
+    }
+
+    void Append(char c)
+    {
+        out->data[out->size++] = c;
+    }
+
+    void Append(const_string str)
+    {
+        if (str.size > 0) {
+            MemCopy(out->data + out->size, str.data, str.size);
+            out->size += str.size;
+        }
+    }
+
+    void AppendRepeated(char c, uint32 count)
+    {
+        MemSet(out->data + out->size, c, count);
+        out->size += count;
+    }
+
+    void AppendEscapedJson(const_string str)
+    {
+        out->size = (uint32)(WriteJsonEscaped(str, out->data + out->size) - out->data);
+    }
+};
+
+template <typename Allocator>
+internal bool KmkvToStringRecursive(const HashTable<KmkvItem<Allocator>>& kmkv, uint32 indentSpaces,
+                                    KmkvWriter<Allocator>* out)
+{
+    for (const KeyValuePair<KmkvItem<Allocator>>& pair : kmkv) {
+        const const_string key = pair.key.s.ToConstArray();
+        const KmkvItem<Allocator>& item = pair.value;
+        const Array<char> value = item.type == KmkvItemType::STRING ? item.dynamicStringPtr->ToArray()
+            : Array<char>::empty;
+        // Key, {tag}, " {\n", value, "\n", closing bracket and "\n", with up to 2 indents
+        if (!out->Reserve(indentSpaces * 2 + key.size + item.keywordTag.size + value.size + 16)) {
+            return false;
+        }
+
+        out->AppendRepeated(' ', indentSpaces);
+        out->Append(key);
         switch (item.type) {
             case KmkvItemType::NONE: {
             } break;
             case KmkvItemType::STRING: {
                 if (item.keywordTag.size > 0) {
-                    outString->Append('{');
-                    outString->Append(item.keywordTag.ToArray());
-                    outString->Append('}');
+                    out->Append('{');
+                    out->Append(item.keywordTag.ToArray());
+                    out->Append('}');
                 }
-                outString->Append(' ');
+                out->Append(' ');
 
-                bool inlineValue = item.dynamicStringPtr->IndexOf('\n') == item.dynamicStringPtr->size;
+                const bool inlineValue = value.FindFirst('\n') == value.size;
                 if (!inlineValue) {
-                    outString->Append('{');
-                    outString->Append('\n');
+                    out->Append('{');
+                    out->Append('\n');
                 }
-                outString->Append(item.dynamicStringPtr->ToArray());
+                out->Append(value);
                 if (!inlineValue) {
-                    outString->Append('\n');
-                    for (int j = 0; j < indentSpaces; j++) outString->Append(' ');
-                    outString->Append('}');
+                    out->Append('\n');
+                    out->AppendRepeated(' ', indentSpaces);
+                    out->Append('}');
                 }
             } break;
             case KmkvItemType::KMKV: {
-                outString->Append(ToString("{kmkv} {\n"));
-                if (!KmkvToStringRecursive(*item.hashTablePtr, indentSpaces + 4, outString)) {
-                    LOG_ERROR("Failed to convert nested kmkv to string, key %.*s\n",
-                              (int)key.s.size, key.s.data);
+                out->Append(ToString("{kmkv} {\n"));
+                if (!KmkvToStringRecursive(*item.hashTablePtr, indentSpaces + 4, out)) {
+                    LOG_ERROR("Failed to convert nested kmkv to string, key %.*s\n", (int)key.size, key.data);
+                    return false;
+                }
+                if (!out->Reserve(indentSpaces + 2)) {
+                    return false;
                 }
-                for (int j = 0; j < indentSpaces; j++) outString->Append(' ');
-                outString->Append('}');
+                out->AppendRepeated(' ', indentSpaces);
+                out->Append('}');
             } break;
         }
 
-        outString->Append('\n');
+        out->Append('\n');
     }
 
     return true;
@@ -375,172 +1469,182 @@ template <typename Allocator>
 bool KmkvToString(const HashTable<KmkvItem<Allocator>>& kmkv,
                   DynamicArray<char, Allocator>* outString)
 {
-    return KmkvToStringRecursive(kmkv, 0, outString);
+    KmkvWriter<Allocator> writer = { .out = outString };
+    return KmkvToStringRecursive(kmkv, 0, &writer);
 }
 
-#ifdef KM_KMKV_JSON
 template <typename Allocator>
 void AddAndMaybeEscapeJson(const Array<char>& string, DynamicArray<char, Allocator>* outJson)
 {
-    for (uint32 i = 0; i < string.size; i++) {
-        switch (string[i]) {
-            case '\b': {
-                outJson->Append('\\');
-                outJson->Append('b');
-            } break;
-            case '\f': {
-                outJson->Append('\\');
-                outJson->Append('f');
-            } break;
-            case '\n': {
-                outJson->Append('\\');
-                outJson->Append('n');
-            } break;
-            case '\r': {
-                outJson->Append('\\');
-                outJson->Append('r');
-            } break;
-            case '\t': {
-                outJson->Append('\\');
-                outJson->Append('t');
-            } break;
-            case '\"': {
-                outJson->Append('\\');
-                outJson->Append('"');
-            } break;
-            case '\\': {
-                outJson->Append('\\');
-                outJson->Append('\\');
-            } break;
-            default: {
-                outJson->Append(string[i]);
-            } break;
-        }
+    KmkvWriter<Allocator> writer = { .out = outJson };
+    if (writer.ReserveEscapedJson(string, 0)) {
+        writer.AppendEscapedJson(string);
     }
 }
 
+// Newline and indent before an item, only when not minifying. Needs depth * 4 + 1 reserved.
 template <typename Allocator>
-internal bool KmkvToJsonRecursive(const HashTable<KmkvItem<Allocator>>& kmkv,
-                                  DynamicArray<char, Allocator>* outJson)
+internal void KmkvJsonNewline(bool minify, uint32 depth, KmkvWriter<Allocator>* out)
 {
-    for (uint32 i = 0; i < kmkv.capacity; i++) {
-        const HashKey& key = kmkv.pairs[i].key;
-        if (key.s.size == 0) {
-            continue;
+    if (!minify) {
+        out->Append('\n');
+        out->AppendRepeated(' ', depth * 4);
+    }
+}
+
+template <typename Allocator>
+internal bool KmkvToJsonRecursive(const HashTable<KmkvItem<Allocator>>& kmkv, uint32 depth, bool minify,
+                                  KmkvWriter<Allocator>* out)
+{
+    if (!out->Reserve(1)) {
+        return false;
+    }
+    out->Append('{');
+
+    bool first = true;
+    for (const KeyValuePair<KmkvItem<Allocator>>& pair : kmkv) {
+        const const_string key = pair.key.s.ToConstArray();
+        // ',', newline and indent, quoted key, ": "
+        if (!out->ReserveEscapedJson(key, (depth + 1) * 4 + 8)) {
+            return false;
+        }
+        if (!first) {
+            out->Append(',');
         }
+        first = false;
+        KmkvJsonNewline(minify, depth + 1, out);
 
-        outJson->Append('"');
-        outJson->Append(key.s.ToArray());
-        outJson->Append('"');
-        outJson->Append(':');
-        const KmkvItem<Allocator>& item = kmkv.pairs[i].value;
+        out->Append('"');
+        out->AppendEscapedJson(key);
+        out->Append('"');
+        out->Append(':');
+        if (!minify) {
+            out->Append(' ');
+        }
+
+        const KmkvItem<Allocator>& item = pair.value;
         switch (item.type) {
             case KmkvItemType::NONE: {
+                if (!out->Reserve(4)) {
+                    return false;
+                }
+                out->Append(ToString("null"));
             } break;
             case KmkvItemType::STRING: {
                 if (StringEquals(item.keywordTag.ToArray(), ToString("array"))) {
-                    outJson->Append('[');
+                    if (!out->Reserve(2)) {
+                        return false;
+                    }
+                    out->Append('[');
                     Array<char> arrayString = item.dynamicStringPtr->ToArray();
-                    bool atLeastOne = arrayString.size > 0;
+                    bool firstElement = true;
                     while (arrayString.size > 0) {
-                        Array<char> split = NextSplitElement(&arrayString, ',');
-                        split = TrimWhitespace(split);
-                        outJson->Append('"');
-                        AddAndMaybeEscapeJson(split, outJson);
-                        outJson->Append('"');
-                        outJson->Append(',');
-                    }
-                    if (atLeastOne) {
-                        outJson->RemoveLast();
+                        const Array<char> element = TrimWhitespace(NextSplitElement(&arrayString, ','));
+                        // ", " and quotes
+                        if (!out->ReserveEscapedJson(element, 5)) {
+                            return false;
+                        }
+                        if (!firstElement) {
+                            out->Append(',');
+                            if (!minify) {
+                                out->Append(' ');
+                            }
+                        }
+                        firstElement = false;
+
+                        out->Append('"');
+                        out->AppendEscapedJson(element);
+                        out->Append('"');
                     }
-                    outJson->Append(']');
+                    out->Append(']');
                 }
                 else {
-                    outJson->Append('"');
-                    AddAndMaybeEscapeJson(item.dynamicStringPtr->ToArray(), outJson);
-                    outJson->Append('"');
+                    const Array<char> value = item.dynamicStringPtr->ToArray();
+                    if (!out->ReserveEscapedJson(value, 2)) {
+                        return false;
+                    }
+                    out->Append('"');
+                    out->AppendEscapedJson(value);
+                    out->Append('"');
                 }
             } break;
             case KmkvItemType::KMKV: {
-                outJson->Append('{');
-                if (!KmkvToJsonRecursive(*item.hashTablePtr, outJson)) {
+                if (!KmkvToJsonRecursive(*item.hashTablePtr, depth + 1, minify, out)) {
                     return false;
                 }
-                outJson->Append('}');
             } break;
         }
-
-        outJson->Append(',');
     }
 
-    if ((*outJson)[outJson->size - 1] == ',') {
-        outJson->RemoveLast();
+    if (!out->Reserve(depth * 4 + 2)) {
+        return false;
     }
-
+    if (!first) {
+        KmkvJsonNewline(minify, depth, out);
+    }
+    out->Append('}');
     return true;
 }
 
 template <typename Allocator>
-bool KmkvToJson(const HashTable<KmkvItem<Allocator>>& kmkv, DynamicArray<char, Allocator>* outJson)
+bool KmkvToJson(const HashTable<KmkvItem<Allocator>>& kmkv, DynamicArray<char, Allocator>* outJson, bool minify)
 {
-    outJson->Append('{');
-    if (!KmkvToJsonRecursive(kmkv, outJson)) {
-        return false;
-    }
-    outJson->Append('}');
-
-    return true;
+    KmkvWriter<Allocator> writer = { .out = outJson };
+    return KmkvToJsonRecursive(kmkv, 0, minify, &writer);
 }
 
 template <typename Allocator>
-internal bool JsonToKmkvRecursive(const cJSON* json, Allocator* allocator,
+internal bool JsonToKmkvRecursive(const JsonDocument<>& json, uint32 objectIndex, Allocator* allocator,
                                   HashTable<KmkvItem<Allocator>>* outKmkv)
 {
-    const cJSON* child = json->child;
-    while (child != NULL && child->string != NULL) {
-        KmkvItem<Allocator>* item = outKmkv->Add(child->string);
-        if (cJSON_IsObject(child)) {
-            item->type = KmkvItemType::KMKV;
-            item->hashTablePtr = allocator->template New<HashTable<KmkvItem<Allocator>, Allocator>>();
-            DEBUG_ASSERT(item->hashTablePtr != nullptr);
-            new (item->hashTablePtr) HashTable<KmkvItem<Allocator>, Allocator>();
-            if (!JsonToKmkvRecursive(child, allocator, item->hashTablePtr)) {
-                LOG_ERROR("Failed to parse child JSON object, key %s\n", child->string);
-                return false;
-            }
+    const Array<JsonValue>& tape = json.tape;
+    for (uint32 i = objectIndex + 1; i < tape[objectIndex].next; i = tape[i + 1].next) {
+        const JsonValue& key = tape[i];
+        const JsonValue& value = tape[i + 1];
+        if (key.str.size > HashKey::MAX_LENGTH) {
+            LOG_ERROR("JSON key too long: %.*s\n", (int)key.str.size, key.str.data);
+            return false;
         }
-        else if (cJSON_IsString(child)) {
-            item->type = KmkvItemType::STRING;
-            item->dynamicStringPtr = allocator->template New<DynamicArray<char, Allocator>>();
-            DEBUG_ASSERT(item->dynamicStringPtr != nullptr);
-            new (item->dynamicStringPtr) DynamicArray<char, Allocator>(ToNonConstString(ToString(child->valuestring)));
-        }
-        else if (cJSON_IsArray(child)) {
-            item->type = KmkvItemType::STRING;
-            item->dynamicStringPtr = allocator->template New<DynamicArray<char, Allocator>>();
-            DEBUG_ASSERT(item->dynamicStringPtr != nullptr);
-            new (item->dynamicStringPtr) DynamicArray<char, Allocator>();
-
-            const cJSON* arrayItem;
-            cJSON_ArrayForEach(arrayItem, child) {
-                if (!cJSON_IsString(arrayItem)) {
-                    LOG_ERROR("JSON array item not a string, key %s\n", child->string);
+
+        KmkvItem<Allocator>* item = outKmkv->Add(HashKey(key.str));
+        new (item) KmkvItem<Allocator>();
+        switch (value.type) {
+            case JsonType::OBJECT: {
+                item->type = KmkvItemType::KMKV;
+                item->hashTablePtr = allocator->template New<HashTable<KmkvItem<Allocator>, Allocator>>();
+                DEBUG_ASSERT(item->hashTablePtr != nullptr);
+                new (item->hashTablePtr) HashTable<KmkvItem<Allocator>, Allocator>();
+                if (!JsonToKmkvRecursive(json, i + 1, allocator, item->hashTablePtr)) {
+                    LOG_ERROR("Failed to parse child JSON object, key %.*s\n", (int)key.str.size, key.str.data);
                     return false;
                 }
-                item->dynamicStringPtr->Append(ToString(arrayItem->valuestring));
-                item->dynamicStringPtr->Append(',');
-            }
-            if (cJSON_GetArraySize(child) > 0) {
-                item->dynamicStringPtr->RemoveLast();
-            }
-            item->keywordTag.Append(ToString("array"));
-        }
-        else {
-            LOG_ERROR("Unhandled JSON type: %d\n", child->type);
-            return false;
-        }
+            } break;
+            case JsonType::ARRAY: {
+                item->type = KmkvItemType::STRING;
+                item->dynamicStringPtr = allocator->template New<DynamicArray<char, Allocator>>();
+                DEBUG_ASSERT(item->dynamicStringPtr != nullptr);
+                new (item->dynamicStringPtr) DynamicArray<char, Allocator>();
 
-        child = child->next;
+                for (uint32 j = i + 2; j < value.next; j = tape[j].next) {
+                    if (tape[j].type == JsonType::ARRAY || tape[j].type == JsonType::OBJECT) {
+                        LOG_ERROR("JSON array item not a scalar, key %.*s\n", (int)key.str.size, key.str.data);
+                        return false;
+                    }
+                    item->dynamicStringPtr->Append(tape[j].str);
+                    item->dynamicStringPtr->Append(',');
+                }
+                if (value.next > i + 2) {
+                    item->dynamicStringPtr->RemoveLast();
+                }
+                item->keywordTag.Append(ToString("array"));
+            } break;
+            default: {
+                item->type = KmkvItemType::STRING;
+                item->dynamicStringPtr = allocator->template New<DynamicArray<char, Allocator>>();
+                DEBUG_ASSERT(item->dynamicStringPtr != nullptr);
+                new (item->dynamicStringPtr) DynamicArray<char, Allocator>(ToNonConstString(value.str));
+            } break;
+        }
     }
 
     return true;
@@ -550,21 +1654,16 @@ template <typename Allocator>
 bool JsonToKmkv(const Array<char>& jsonString, Allocator* allocator,
                 HashTable<KmkvItem<Allocator>>* outKmkv)
 {
-    const char* jsonCString = ToCString(jsonString, allocator);
-    cJSON* json = cJSON_Parse(jsonCString);
-    if (json == NULL) {
-        const char *errorPtr = cJSON_GetErrorPtr();
-        if (errorPtr != NULL) {
-            LOG_ERROR("Error parsing JSON before: %s\n", errorPtr);
-        }
+    // The tape is temporary, so it goes on the default allocator instead of in between the KMKV items
+    JsonDocument<> json;
+    defer(json.Free());
+    if (!ParseJson(jsonString, &json)) {
         return false;
     }
-    defer(cJSON_Delete(json));
 
-    if (!cJSON_IsObject(json)) {
-        LOG_ERROR("Top-level json not object type: %s\n", jsonCString);
+    if (json.tape[0].type != JsonType::OBJECT) {
+        LOG_ERROR("Top-level json not object type\n");
         return false;
     }
-    return JsonToKmkvRecursive(json, allocator, outKmkv);
+    return JsonToKmkvRecursive(json, 0, allocator, outKmkv);
 }
-#endif
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "km_atomic.h"
 #include "km_container.h"
+#include "km_json.h"
 #include "km_memory.h"
 #include "km_string.h"
 
@@ -26,10 +28,209 @@ struct KmkvItem
     ~KmkvItem();
 };
 
+// Read-only KMKV tree from ParseKmkvInPlace. Strings are slices of the parsed buffer, and nodes are
+// allocated from a single LinearAllocator, so there are no per-item copies or heap allocations.
+struct KmkvNode
+{
+    string key;
+    string keywordTag;
+    uint32 keyHash; // KeyHash(key)
+
+    KmkvItemType type;
+    string strValue; // STRING only
+    KmkvNode* firstChild; // KMKV only, children in file order
+    uint32 numChildren;
+
+    KmkvNode* next;
+};
+
+// Both the buffer and the allocator's memory have to outlive the returned tree.
+// Unlike LoadKmkv, duplicate keywords aren't detected, lookups return the first one.
+bool ParseKmkvInPlace(const_string kmkvString, LinearAllocator* allocator, KmkvNode* outRoot);
+
+/*
+Multithreaded ParseKmkvInPlace, for files with many top-level {kmkv} blocks:
+1. BeginParseKmkvParallel does the top level on the calling thread, blocks are only bracket-matched.
+2. Worker threads (e.g. AppWorkQueue entries) call ParseKmkvParallelWork, each with its own arena.
+   Blocks are claimed one at a time, so any number of calls can run at once.
+3. Once every ParseKmkvParallelWork call has returned, EndParseKmkvParallel reports whether all blocks
+   parsed. Nested nodes live in the worker arenas, which have to outlive the tree.
+*/
+struct KmkvParallelParser
+{
+    Array<KmkvNode*> blocks; // top-level {kmkv} nodes, holding their unparsed block until claimed
+    volatile uint32 nextBlock;
+    volatile uint32 failed;
+};
+
+bool BeginParseKmkvParallel(const_string kmkvString, LinearAllocator* allocator, KmkvNode* outRoot,
+                            KmkvParallelParser* outParser);
+void ParseKmkvParallelWork(KmkvParallelParser* parser, LinearAllocator* threadAllocator);
+bool EndParseKmkvParallel(KmkvParallelParser* parser);
+
+const KmkvNode* GetKmkvNode(const KmkvNode& kmkv, const_string itemKey);
+const KmkvNode* GetKmkvNode(const KmkvNode& kmkv, const HashedKey& itemKey);
+const string* GetKmkvItemStrValue(const KmkvNode& kmkv, const_string itemKey);
+const string* GetKmkvItemStrValue(const KmkvNode& kmkv, const HashedKey& itemKey);
+const KmkvNode* GetKmkvItemObjValue(const KmkvNode& kmkv, const_string itemKey);
+const KmkvNode* GetKmkvItemObjValue(const KmkvNode& kmkv, const HashedKey& itemKey);
+
+// Dotted path to a nested item, e.g. "player.stats.speed". Compile once, keys are hashed up front.
+// The key strings are slices of the path string, which has to outlive the KmkvPath.
+static const uint32 KMKV_PATH_MAX_DEPTH = 8;
+
+struct KmkvPath
+{
+    uint32 depth;
+    HashedKey keys[KMKV_PATH_MAX_DEPTH];
+};
+
+bool CompileKmkvPath(const_string path, KmkvPath* outPath);
+
+const KmkvNode* GetKmkvNode(const KmkvNode& kmkv, const KmkvPath& path);
+const string* GetKmkvItemStrValue(const KmkvNode& kmkv, const KmkvPath& path);
+const KmkvNode* GetKmkvItemObjValue(const KmkvNode& kmkv, const KmkvPath& path);
+
+/*
+Struct binding: describe a struct's fields once, then load {kmkv} objects straight into it.
+    struct Stats { float32 speed; int32 hp; };
+    const KmkvField STATS_FIELDS[] = {
+        KMKV_FIELD(Stats, speed, FLOAT32),
+        KMKV_FIELD(Stats, hp, INT32),
+    };
+    const KmkvBinding STATS_BINDING = KMKV_BINDING(STATS_FIELDS);
+    LoadKmkvStruct(*statsNode, STATS_BINDING, &stats);
+Vectors are whitespace-separated ("1 0 0.5"), bools are "true"/"false".
+*/
+enum class KmkvFieldType
+{
+    STRING, // string, a slice of the parsed buffer
+    BOOL,
+    INT32,
+    UINT32,
+    INT64,
+    UINT64,
+    FLOAT32,
+    FLOAT64,
+    VEC2,
+    VEC3,
+    VEC4,
+    OBJECT // nested struct, described by KmkvField::binding
+};
+
+struct KmkvBinding;
+
+struct KmkvField
+{
+    HashedKey key;
+    KmkvFieldType type;
+    uint32 offset;
+    const KmkvBinding* binding; // OBJECT only
+};
+
+struct KmkvBinding
+{
+    Array<const KmkvField> fields;
+};
+
+// Field keyed by the member name, or by a different key with KMKV_FIELD_KEY
+#define KMKV_FIELD_KEY(structType, member, keyString, fieldType) (KmkvField { \
+    .key = KM_KEY(keyString), \
+    .type = KmkvFieldType::fieldType, \
+    .offset = (uint32)offsetof(structType, member), \
+    .binding = nullptr \
+})
+#define KMKV_FIELD(structType, member, fieldType) KMKV_FIELD_KEY(structType, member, #member, fieldType)
+#define KMKV_FIELD_OBJECT(structType, member, memberBinding) (KmkvField { \
+    .key = KM_KEY(#member), \
+    .type = KmkvFieldType::OBJECT, \
+    .offset = (uint32)offsetof(structType, member), \
+    .binding = &(memberBinding) \
+})
+#define KMKV_BINDING(fieldArray) (KmkvBinding { \
+    .fields = { .size = C_ARRAY_LENGTH(fieldArray), .data = (fieldArray) } \
+})
+
+// Single pass over the object's items, each converted straight into its field.
+// Items without a field are ignored and fields without an item keep their value.
+// Fails on type mismatches and unparseable values, outStruct may be partially loaded then.
+bool LoadKmkvStruct(const KmkvNode& kmkv, const KmkvBinding& binding, void* outStruct);
+
+/*
+Binary KMKV, queried in place (e.g. straight from MapFile) without building anything.
+Pointer-free: every reference is a uint32 byte offset from the start of the buffer, native byte order.
+    KmkvBinaryHeader
+    objects, 4-byte aligned: KmkvBinaryObjectHeader, KmkvBinaryItem[numItems], uint32 index[indexCapacity]
+    strings, each followed by a '\0'
+The index is an open-addressed hash table (linear probing on keyHash) of item index + 1, 0 is empty.
+*/
+static const uint32 KMKV_BINARY_MAGIC = 0x424b4d4b; // "KMKB"
+static const uint32 KMKV_BINARY_VERSION = 1;
+
+struct KmkvBinaryHeader
+{
+    uint32 magic;
+    uint32 version;
+    uint32 size;
+    uint32 rootOffset;
+};
+
+struct KmkvBinaryObjectHeader
+{
+    uint32 numItems;
+    uint32 indexCapacity; // power of 2
+};
+
+struct KmkvBinaryItem
+{
+    uint32 keyHash;
+    uint32 keyOffset;
+    uint32 keySize;
+    uint32 tagOffset;
+    uint32 tagSize;
+    uint32 type; // KmkvItemType
+    uint32 valueOffset; // string for STRING, KmkvBinaryObjectHeader for KMKV
+    uint32 valueSize;
+};
+
+// An object inside a binary KMKV buffer
+struct KmkvBinaryObject
+{
+    Array<const uint8> data;
+    uint32 offset;
+};
+
+// Returns false if outBinary can't grow, its contents are then incomplete
+template <typename Allocator>
+bool KmkvToBinary(const KmkvNode& kmkv, DynamicArray<uint8, Allocator>* outBinary);
+// Only checks the header, the buffer has to stay alive while the returned root is in use
+bool LoadKmkvBinary(const Array<const uint8>& data, KmkvBinaryObject* outRoot);
+
+bool GetKmkvItemStrValue(const KmkvBinaryObject& kmkv, const_string itemKey, Array<const char>* outValue);
+bool GetKmkvItemStrValue(const KmkvBinaryObject& kmkv, const HashedKey& itemKey, Array<const char>* outValue);
+bool GetKmkvItemObjValue(const KmkvBinaryObject& kmkv, const_string itemKey, KmkvBinaryObject* outValue);
+bool GetKmkvItemObjValue(const KmkvBinaryObject& kmkv, const HashedKey& itemKey, KmkvBinaryObject* outValue);
+
+// Input for ReadKmkvStream: fills up to bufferSize bytes, returns how many, 0 at the end, < 0 on error
+using KmkvStreamReadCallback = int (*)(char* buffer, uint32 bufferSize, void* userData);
+
+/*
+Event-based KMKV reader, for inputs too big to load. Pulls through readCallback into the caller's
+buffer and uses no other memory, but every item (keyword and value) has to fit in the buffer.
+Handler is any type with these methods, each returning false to stop reading:
+    bool OnKey(const_string key, const_string keywordTag);
+    bool OnString(const_string value);  // after OnKey, for string items
+    bool OnBeginObject();               // after OnKey, for {kmkv} items
+    bool OnEndObject();
+Strings passed to the handler are only valid until it returns.
+*/
+template <typename Handler>
+bool ReadKmkvStream(KmkvStreamReadCallback readCallback, void* userData, Array<char> buffer, Handler* handler);
+
 int ReadNextKeywordValue(const_string str, string* outKeyword, string* outValue);
 
 // NOTE(patio) deprecated! just use the way simpler API
-template <uint64 KEYWORD_SIZE, typename Allocator>
+template <uint32 KEYWORD_SIZE, typename Allocator>
 int ReadNextKeywordValue(const Array<char>& str,
                          FixedArray<char, KEYWORD_SIZE>* outKeyword, DynamicArray<char, Allocator>* outValue);
 
@@ -46,6 +247,20 @@ template <typename Allocator>
 const HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
                                                           const HashKey& itemKey);
 
+// Same lookups with a precomputed hash, e.g. GetKmkvItemStrValue(kmkv, KM_KEY("name"))
+template <typename Allocator>
+DynamicArray<char, Allocator>* GetKmkvItemStrValue(HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                   const HashedKey& itemKey);
+template <typename Allocator>
+const DynamicArray<char, Allocator>* GetKmkvItemStrValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                         const HashedKey& itemKey);
+template <typename Allocator>
+HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                    const HashedKey& itemKey);
+template <typename Allocator>
+const HashTable<KmkvItem<Allocator>>* GetKmkvItemObjValue(const HashTable<KmkvItem<Allocator>, Allocator>& kmkv,
+                                                          const HashedKey& itemKey);
+
 template <typename Allocator>
 bool LoadKmkv(const Array<char>& filePath, Allocator* allocator,
               HashTable<KmkvItem<Allocator>>* outKmkv);
@@ -53,14 +268,66 @@ bool LoadKmkv(const Array<char>& filePath, Allocator* allocator,
 template <typename Allocator>
 bool LoadKmkv(const Array<char>& kmkvString, HashTable<KmkvItem<Allocator>, Allocator>* outKmkv);
 
+enum class KmkvChangeType
+{
+    ADDED,
+    REMOVED,
+    MODIFIED // value, keyword tag or item type changed
+};
+
+struct KmkvChange
+{
+    KmkvChangeType type;
+    uint32 pathStart; // dotted path, e.g. "player.stats.hp", in KmkvChangeset::pathChars
+    uint32 pathSize;
+};
+
+// Changes are reported at the outermost item that changed: a modified object only reports the items
+// that changed inside it, and an added or removed object is a single change.
+template <typename Allocator = StandardAllocator>
+struct KmkvChangeset
+{
+    DynamicArray<KmkvChange, Allocator> changes;
+    DynamicArray<char, Allocator> pathChars;
+
+    KmkvChangeset(Allocator* allocator = nullptr);
+    KmkvChangeset(const KmkvChangeset<Allocator>& other) = delete;
+
+    const_string GetPath(uint32 changeIndex) const;
+    // True if a change is at path, inside it, or replaced one of its parents
+    bool Affects(const_string path) const;
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr);
+    void Free();
+};
+
+/*
+Hot-reload: parses the new contents, then diffs them into kmkv in place. Unchanged items, including
+whole unchanged objects, keep their memory, so pointers into them stay valid. Modified strings are
+updated in their existing DynamicArray. On a parse error, kmkv is left as it was and false is returned.
+NOTE: removing items can change the iteration order of their table, see HashTable::Remove.
+NOTE: StandardAllocator only. Items move between a temporary table and kmkv, and their memory is
+released out of allocation order, which would roll back a LinearAllocator over live items.
+*/
+template <typename Allocator>
+bool ReloadKmkv(const Array<char>& filePath, Allocator* allocator,
+                HashTable<KmkvItem<Allocator>>* kmkv, KmkvChangeset<Allocator>* outChangeset);
+
+template <typename Allocator>
+bool ReloadKmkv(const Array<char>& kmkvString, HashTable<KmkvItem<Allocator>, Allocator>* kmkv,
+                KmkvChangeset<Allocator>* outChangeset);
+
+// The serializers reserve room once per item and copy clean runs of the values in bulk
 template <typename Allocator>
 bool KmkvToString(const HashTable<KmkvItem<Allocator>>& kmkv,
                   DynamicArray<char, Allocator>* outString);
 
-#ifdef KM_KMKV_JSON
+// minify false puts every item on its own line, indented by 4 spaces per level
 template <typename Allocator>
-bool KmkvToJson(const HashTable<KmkvItem<Allocator>>& kmkv, DynamicArray<char, Allocator>* outJson);
+bool KmkvToJson(const HashTable<KmkvItem<Allocator>>& kmkv, DynamicArray<char, Allocator>* outJson,
+                bool minify = true);
+// Objects become {kmkv} items, arrays "array"-tagged comma-separated strings, scalars their JSON text
 template <typename Allocator>
 bool JsonToKmkv(const Array<char>& jsonString, Allocator* allocator,
                 HashTable<KmkvItem<Allocator>>* outKmkv);
-#endif
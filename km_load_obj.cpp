@@ -15,12 +15,14 @@ union FaceIndices
 
 bool StringToObjFaceInds(const_string str, FaceIndices* faceInds)
 {
-    int numElements;
-    bool result = StringToElementArray(str, '/', false, StringToIntBase10, 2, faceInds->values, &numElements);
+    uint32 numElements;
+    if (!ParseNumbers(str, '/', Array<int> { .size = 2, .data = faceInds->values }, &numElements)) {
+        return false;
+    }
     if (numElements == 1) {
         faceInds->uv = -1;
     }
-    return result && (numElements == 1 || numElements == 2);
+    return true;
 }
 
 bool LoadObj(const_string filePath, Vec3 offset, float32 scale, LoadObjResult* result, LinearAllocator* allocator)
@@ -40,24 +42,17 @@ bool LoadObj(const_string filePath, Vec3 offset, float32 scale, LoadObjResult* r
     DynamicArray<uint32, LinearAllocator> startTriangleInds(allocator);
     DynamicArray<uint32, LinearAllocator> startQuadInds(allocator);
 
-    string fileString = {
+    const_string fileString = {
         .size = result->file.size,
-        .data = (char*)result->file.data
+        .data = (const char*)result->file.data
     };
+    LineIterator lines(fileString);
     string next;
 
     uint32 currentMaterialIndex = 0;
 
     bool firstMesh = true;
-    while (true) {
-        next = NextSplitElement(&fileString, '\n');
-        if (next.size > 0 && next[next.size - 1] == '\r') {
-            next.size--;
-        }
-        if (fileString.size == 0 && next.size == 0) {
-            break;
-        }
-
+    while (lines.Next(&next)) {
         if (next.size < 2) continue;
 
         // Handle new model
@@ -97,8 +92,8 @@ bool LoadObj(const_string filePath, Vec3 offset, float32 scale, LoadObjResult* r
             next.size -= 2;
 
             Vec3* p = positions.Append();
-            int numElements;
-            if (!StringToElementArray(next, ' ', false, StringToFloat32, 3, p->e, &numElements)) {
+            uint32 numElements;
+            if (!ParseNumbers(next, ' ', Array<float32> { .size = 3, .data = p->e }, &numElements)) {
                 LOG_ERROR("Failed to load vertex position with value: %.*s\n", (int)next.size, next.data);
                 return false;
             }
@@ -121,8 +116,8 @@ bool LoadObj(const_string filePath, Vec3 offset, float32 scale, LoadObjResult* r
             next.size -= 3;
 
             Vec2* uv = uvs.Append();
-            int numElements;
-            if (!StringToElementArray(next, ' ', false, StringToFloat32, 2, uv->e, &numElements)) {
+            uint32 numElements;
+            if (!ParseNumbers(next, ' ', Array<float32> { .size = 2, .data = uv->e }, &numElements)) {
                 LOG_ERROR("Failed to load vertex UV with value: %.*s\n", (int)next.size, next.data);
                 return false;
             }
@@ -142,10 +137,19 @@ bool LoadObj(const_string filePath, Vec3 offset, float32 scale, LoadObjResult* r
             next.size -= 2;
 
             FaceIndices indices[MAX_FACE_VERTICES];
-            int numElements;
-            if (!StringToElementArray(next, ' ', false, StringToObjFaceInds, MAX_FACE_VERTICES, indices, &numElements)) {
-                LOG_ERROR("Failed to load face with value: %.*s\n", (int)next.size, next.data);
-                return false;
+            int numElements = 0;
+            SplitIterator faceVertices(next, ' ');
+            string faceVertex;
+            while (faceVertices.Next(&faceVertex)) {
+                if (faceVertices.done && faceVertex.size == 0 && numElements > 0) {
+                    // Nothing after the last separator
+                    break;
+                }
+                if (numElements == MAX_FACE_VERTICES || !StringToObjFaceInds(faceVertex, &indices[numElements])) {
+                    LOG_ERROR("Failed to load face with value: %.*s\n", (int)next.size, next.data);
+                    return false;
+                }
+                numElements++;
             }
 
             if (numElements < 3) {
@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include "km_defines.h"
+#include "km_random.h"
 
 #define PI_F 3.14159265f
 #define E_F  2.71828182f
@@ -48,15 +49,14 @@ inline float32 CeilFloat32(float32 f)
     return (float32)ceil(f);
 }
 
+// NOTE these use the calling thread's generator, see GetThreadRandom in km_random.h
 inline int RandInt(int max)
 {
-	DEBUG_ASSERT(max > 0);
-	return rand() % max;
+	return GetThreadRandom()->Int(max);
 }
 inline int RandInt(int min, int max)
 {
-	DEBUG_ASSERT(max > min);
-	return rand() % (max - min) + min;
+	return GetThreadRandom()->Int(min, max);
 }
 
 inline int MinInt(int a, int b) {
@@ -69,15 +69,13 @@ inline int ClampInt(int a, int min, int max) {
     return MinInt(MaxInt(a, min), max);
 }
 
-inline int RandUInt32(uint32 max)
+inline uint32 RandUInt32(uint32 max)
 {
-	DEBUG_ASSERT(max > 0);
-	return rand() % max;
+	return GetThreadRandom()->UInt32(max);
 }
-inline int RandUInt32(uint32 min, uint32 max)
+inline uint32 RandUInt32(uint32 min, uint32 max)
 {
-	DEBUG_ASSERT(max > min);
-	return rand() % (max - min) + min;
+	return GetThreadRandom()->UInt32(min, max);
 }
 
 inline uint32 MinUInt32(uint32 a, uint32 b) {
@@ -139,12 +137,11 @@ inline float32 Cos32(float32 x)
 
 inline float32 RandFloat32()
 {
-	return (float32)rand() / RAND_MAX;
+	return GetThreadRandom()->Float32();
 }
 inline float32 RandFloat32(float32 min, float32 max)
 {
-	DEBUG_ASSERT(max > min);
-	return RandFloat32() * (max - min) + min;
+	return GetThreadRandom()->Float32(min, max);
 }
 
 inline float32 MinFloat32(float32 a, float32 b) {
@@ -4,8 +4,13 @@
 #include <Windows.h>
 #undef ERROR
 #elif GAME_LINUX
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #endif
 
 #if GAME_WIN32
@@ -95,6 +100,75 @@ void FreeFile(Array<uint8> file, Allocator* allocator)
     allocator->Free(file.data);
 }
 
+Array<uint8> MapFile(const_string filePath)
+{
+    Array<uint8> file = { .size = 0, .data = nullptr };
+    char* cFilePath = ToCString(filePath, &defaultAllocator_);
+    defer(defaultAllocator_.Free(cFilePath));
+
+#if GAME_WIN32
+    HANDLE hFile = CreateFile(cFilePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, NULL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return file;
+    }
+    defer(CloseHandle(hFile));
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+        return file;
+    }
+
+    // The view keeps the mapping alive after its handle is closed
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL) {
+        return file;
+    }
+    defer(CloseHandle(hMapping));
+
+    void* data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        return file;
+    }
+
+    file.size = SafeTruncateUInt64(fileSize.QuadPart);
+    file.data = (uint8*)data;
+#elif GAME_LINUX
+    const int fd = open(cFilePath, O_RDONLY);
+    if (fd == -1) {
+        return file;
+    }
+    defer(close(fd));
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        return file;
+    }
+
+    void* data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return file;
+    }
+
+    file.size = SafeTruncateUInt64(fileStat.st_size);
+    file.data = (uint8*)data;
+#else
+#error "MapFile not implemented on this platform"
+#endif
+
+    return file;
+}
+
+void UnmapFile(Array<uint8> file)
+{
+#if GAME_WIN32
+    UnmapViewOfFile(file.data);
+#elif GAME_LINUX
+    munmap(file.data, file.size);
+#else
+#error "UnmapFile not implemented on this platform"
+#endif
+}
+
 bool WriteFile(const_string filePath, const Array<uint8>& data, bool append)
 {
     char* cFilePath = ToCString(filePath, &defaultAllocator_);
@@ -147,6 +221,90 @@ bool WriteFile(const_string filePath, const Array<uint8>& data, bool append)
 #endif
 }
 
+template <typename Allocator>
+bool WriteFile(const_string filePath, const StringBuilder<Allocator>& builder, bool append)
+{
+    char* cFilePath = ToCString(filePath, &defaultAllocator_);
+    defer(defaultAllocator_.Free(cFilePath));
+
+#if GAME_WIN32
+    HANDLE hFile = CreateFile(cFilePath, GENERIC_WRITE, NULL, NULL, OPEN_ALWAYS, NULL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    defer(CloseHandle(hFile));
+
+    if (append) {
+        DWORD dwPos = SetFilePointer(hFile, 0, NULL, FILE_END);
+        if (dwPos == INVALID_SET_FILE_POINTER) {
+            return false;
+        }
+    }
+    else {
+        DWORD dwPos = SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+        if (dwPos == INVALID_SET_FILE_POINTER) {
+            return false;
+        }
+        if (SetEndOfFile(hFile) == 0) {
+            return false;
+        }
+    }
+
+    for (StringBuilderChunk* chunk = builder.first; chunk != nullptr; chunk = chunk->next) {
+        DWORD bytesWritten;
+        if (!WriteFile(hFile, StringBuilderChunkData(chunk), (DWORD)chunk->size, &bytesWritten, NULL)
+            || bytesWritten != (DWORD)chunk->size) {
+            return false;
+        }
+    }
+
+    return true;
+#elif GAME_LINUX
+    const int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+    const int fd = open(cFilePath, flags, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    defer(close(fd));
+
+    // One writev per IOV_MAX chunks, resuming mid-chunk after partial writes
+    iovec iovs[64];
+    const int maxIovs = IOV_MAX < 64 ? IOV_MAX : 64;
+    const StringBuilderChunk* chunk = builder.first;
+    uint32 chunkOffset = 0;
+    while (chunk != nullptr) {
+        int numIovs = 0;
+        for (const StringBuilderChunk* c = chunk; c != nullptr && numIovs < maxIovs; c = c->next) {
+            const uint32 offset = c == chunk ? chunkOffset : 0;
+            if (c->size > offset) {
+                iovs[numIovs].iov_base = StringBuilderChunkData((StringBuilderChunk*)c) + offset;
+                iovs[numIovs].iov_len = c->size - offset;
+                numIovs++;
+            }
+        }
+        if (numIovs == 0) {
+            break;
+        }
+
+        ssize_t written = writev(fd, iovs, numIovs);
+        if (written < 0) {
+            return false;
+        }
+
+        while (chunk != nullptr && (uint64)written >= chunk->size - chunkOffset) {
+            written -= chunk->size - chunkOffset;
+            chunk = chunk->next;
+            chunkOffset = 0;
+        }
+        chunkOffset += (uint32)written;
+    }
+
+    return true;
+#else
+#error "WriteFile not implemented on this platform"
+#endif
+}
+
 bool DeleteFile(const_string filePath, bool errorIfNotFound)
 {
     char* cFilePath = ToCString(filePath, &defaultAllocator_);
@@ -8,7 +8,14 @@ Array<uint8> LoadEntireFile(const_string filePath, Allocator* allocator);
 template <typename Allocator>
 void FreeFile(Array<uint8> file, Allocator* allocator);
 
+// Read-only view of the whole file through the OS page cache, no copy. Release with UnmapFile.
+Array<uint8> MapFile(const_string filePath);
+void UnmapFile(Array<uint8> file);
+
 bool WriteFile(const_string filePath, const Array<uint8>& data, bool append);
+// Writes the builder's chunks in place, without first making them contiguous
+template <typename Allocator>
+bool WriteFile(const_string filePath, const StringBuilder<Allocator>& builder, bool append);
 
 bool DeleteFile(const_string filePath, bool errorIfNotFound);
 
@@ -0,0 +1,237 @@
+#include "km_random.h"
+
+#include "km_atomic.h"
+#include "km_simd.h"
+
+thread_local Random threadRandom_;
+thread_local bool threadRandomSeeded_ = false;
+global_var volatile uint32 threadRandomCount_ = 0;
+
+internal inline uint64 RotateLeft64(uint64 x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64, recommended for expanding a single seed into xoshiro state
+internal inline uint64 SplitMix64(uint64* x)
+{
+    uint64 z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+Random::Random(uint64 seed)
+{
+    Seed(seed);
+}
+
+void Random::Seed(uint64 seed)
+{
+    for (int i = 0; i < 4; i++) {
+        state[i] = SplitMix64(&seed);
+    }
+}
+
+void Random::Jump()
+{
+    static const uint64 JUMP[] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+
+    uint64 s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < (int)C_ARRAY_LENGTH(JUMP); i++) {
+        for (int b = 0; b < 64; b++) {
+            if (JUMP[i] & (1ULL << b)) {
+                s0 ^= state[0];
+                s1 ^= state[1];
+                s2 ^= state[2];
+                s3 ^= state[3];
+            }
+            UInt64();
+        }
+    }
+
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+}
+
+uint64 Random::UInt64()
+{
+    const uint64 result = RotateLeft64(state[0] + state[3], 23) + state[0];
+    const uint64 t = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = RotateLeft64(state[3], 45);
+
+    return result;
+}
+
+uint32 Random::UInt32()
+{
+    // Upper bits are the higher quality ones
+    return (uint32)(UInt64() >> 32);
+}
+
+uint32 Random::UInt32(uint32 max)
+{
+    DEBUG_ASSERT(max > 0);
+
+    // Lemire's multiply-shift with rejection, no modulo bias and usually no division
+    // ( source https://arxiv.org/abs/1805.10941 )
+    uint64 m = (uint64)UInt32() * (uint64)max;
+    uint32 low = (uint32)m;
+    if (low < max) {
+        const uint32 threshold = (0 - max) % max;
+        while (low < threshold) {
+            m = (uint64)UInt32() * (uint64)max;
+            low = (uint32)m;
+        }
+    }
+
+    return (uint32)(m >> 32);
+}
+
+uint32 Random::UInt32(uint32 min, uint32 max)
+{
+    DEBUG_ASSERT(max > min);
+    return min + UInt32(max - min);
+}
+
+int Random::Int(int max)
+{
+    DEBUG_ASSERT(max > 0);
+    return (int)UInt32((uint32)max);
+}
+
+int Random::Int(int min, int max)
+{
+    DEBUG_ASSERT(max > min);
+    return (int)((uint32)min + UInt32((uint32)max - (uint32)min));
+}
+
+float32 Random::Float32()
+{
+    // 24 random mantissa bits, evenly spaced in [0, 1)
+    return (float32)(UInt32() >> 8) * (1.0f / 16777216.0f);
+}
+
+float32 Random::Float32(float32 min, float32 max)
+{
+    DEBUG_ASSERT(max > min);
+    return Float32() * (max - min) + min;
+}
+
+#if KM_SIMD_SSE2
+
+// Below this, setting up the SIMD lanes costs more than it saves
+const uint32 RANDOM_FILL_SIMD_MIN_SIZE = 64;
+
+// xoshiro256++ on 2 independent streams, one per 64-bit lane
+struct RandomLanes
+{
+    __m128i s[4];
+};
+
+template <int K>
+internal inline __m128i SimdRotateLeft64(__m128i x)
+{
+    return _mm_or_si128(_mm_slli_epi64(x, K), _mm_srli_epi64(x, 64 - K));
+}
+
+internal inline __m128i RandomLanesNext(RandomLanes* lanes)
+{
+    __m128i* s = lanes->s;
+    const __m128i result = _mm_add_epi64(SimdRotateLeft64<23>(_mm_add_epi64(s[0], s[3])), s[0]);
+    const __m128i t = _mm_slli_epi64(s[1], 17);
+
+    s[2] = _mm_xor_si128(s[2], s[0]);
+    s[3] = _mm_xor_si128(s[3], s[1]);
+    s[1] = _mm_xor_si128(s[1], s[2]);
+    s[0] = _mm_xor_si128(s[0], s[3]);
+    s[2] = _mm_xor_si128(s[2], t);
+    s[3] = SimdRotateLeft64<45>(s[3]);
+
+    return result;
+}
+
+// Lane streams are seeded from this generator, so Fill is deterministic for a given seed
+internal void InitRandomLanes(Random* random, RandomLanes* lanes)
+{
+    uint64 seed = random->UInt64();
+    for (int i = 0; i < 4; i++) {
+        const uint64 lo = SplitMix64(&seed);
+        const uint64 hi = SplitMix64(&seed);
+        lanes->s[i] = _mm_set_epi64x((long long)hi, (long long)lo);
+    }
+}
+
+#endif
+
+void Random::Fill(Array<uint32> array)
+{
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    if (array.size >= RANDOM_FILL_SIMD_MIN_SIZE) {
+        // 2 independent sets of lanes to hide the dependency chain latency
+        RandomLanes lanes1, lanes2;
+        InitRandomLanes(this, &lanes1);
+        InitRandomLanes(this, &lanes2);
+        for (; array.size - i >= 8; i += 8) {
+            _mm_storeu_si128((__m128i*)(array.data + i), RandomLanesNext(&lanes1));
+            _mm_storeu_si128((__m128i*)(array.data + i + 4), RandomLanesNext(&lanes2));
+        }
+    }
+#endif
+
+    for (; i < array.size; i++) {
+        array.data[i] = UInt32();
+    }
+}
+
+void Random::Fill(Array<float32> array)
+{
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    if (array.size >= RANDOM_FILL_SIMD_MIN_SIZE) {
+        RandomLanes lanes1, lanes2;
+        InitRandomLanes(this, &lanes1);
+        InitRandomLanes(this, &lanes2);
+        const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+        for (; array.size - i >= 8; i += 8) {
+            // Same mapping as Float32(): top 24 bits of each 32-bit lane, exact in int32 -> float32
+            const __m128i bits1 = _mm_srli_epi32(RandomLanesNext(&lanes1), 8);
+            const __m128i bits2 = _mm_srli_epi32(RandomLanesNext(&lanes2), 8);
+            _mm_storeu_ps(array.data + i, _mm_mul_ps(_mm_cvtepi32_ps(bits1), scale));
+            _mm_storeu_ps(array.data + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(bits2), scale));
+        }
+    }
+#endif
+
+    for (; i < array.size; i++) {
+        array.data[i] = Float32();
+    }
+}
+
+Random* GetThreadRandom()
+{
+    if (!threadRandomSeeded_) {
+        SeedThreadRandom(RANDOM_DEFAULT_SEED, AtomicFetchIncrement(&threadRandomCount_));
+    }
+    return &threadRandom_;
+}
+
+void SeedThreadRandom(uint64 seed, uint32 threadIndex)
+{
+    threadRandom_.Seed(seed);
+    for (uint32 i = 0; i < threadIndex; i++) {
+        threadRandom_.Jump();
+    }
+    threadRandomSeeded_ = true;
+}
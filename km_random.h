@@ -0,0 +1,40 @@
+#pragma once
+
+#include "km_array.h"
+#include "km_defines.h"
+
+static const uint64 RANDOM_DEFAULT_SEED = 0x4b617072696b6f6eULL;
+
+// xoshiro256++ generator ( source https://prng.di.unimi.it/ )
+// Small, fast and seedable. Keep one per thread (see GetThreadRandom) instead of sharing one.
+struct Random
+{
+    uint64 state[4];
+
+    Random(uint64 seed = RANDOM_DEFAULT_SEED);
+
+    void Seed(uint64 seed);
+    // Advances the generator by 2^128 steps, used to split one seed into non-overlapping streams
+    void Jump();
+
+    uint64 UInt64();
+    uint32 UInt32();
+    // Unbiased, in [0, max) and [min, max)
+    uint32 UInt32(uint32 max);
+    uint32 UInt32(uint32 min, uint32 max);
+    int Int(int max);
+    int Int(int min, int max);
+    // In [0, 1) and [min, max)
+    float32 Float32();
+    float32 Float32(float32 min, float32 max);
+
+    // Batch generation, SIMD for large arrays
+    void Fill(Array<uint32> array);
+    void Fill(Array<float32> array);
+};
+
+// Generator for the calling thread, used by the RandXXX functions in km_math.h and Array::Shuffle.
+// Threads that never call SeedThreadRandom get distinct streams of RANDOM_DEFAULT_SEED.
+Random* GetThreadRandom();
+// Deterministic per-thread streams: seed, jumped ahead threadIndex times
+void SeedThreadRandom(uint64 seed, uint32 threadIndex);
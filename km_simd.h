@@ -0,0 +1,81 @@
+#pragma once
+
+#include "km_defines.h"
+
+/*
+KM_SIMD_SSE2:
+1 - SSE2 intrinsics available (always the case on x64)
+0 - no SIMD, vectorized kernels fall back to scalar loops
+*/
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KM_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define KM_SIMD_SSE2 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Bit scan helpers for the movemask results of SIMD compares. Undefined for n == 0.
+inline uint32 CountTrailingZeros32(uint32 n)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, n);
+    return (uint32)index;
+#else
+    return (uint32)__builtin_ctz(n);
+#endif
+}
+
+inline uint32 CountTrailingZeros64(uint64 n)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, n);
+    return (uint32)index;
+#else
+    return (uint32)__builtin_ctzll(n);
+#endif
+}
+
+inline uint32 HighestSetBit32(uint32 n)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, n);
+    return (uint32)index;
+#else
+    return 31 - (uint32)__builtin_clz(n);
+#endif
+}
+
+inline uint32 HighestSetBit64(uint64 n)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, n);
+    return (uint32)index;
+#else
+    return 63 - (uint32)__builtin_clzll(n);
+#endif
+}
+
+inline uint32 PopCount32(uint32 n)
+{
+#if defined(_MSC_VER)
+    // __popcnt needs a POPCNT-capable CPU, so stick to the bit trick here
+    n = n - ((n >> 1) & 0x55555555);
+    n = (n & 0x33333333) + ((n >> 2) & 0x33333333);
+    return (((n + (n >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#else
+    return (uint32)__builtin_popcount(n);
+#endif
+}
+
+inline uint32 PopCount64(uint64 n)
+{
+    return PopCount32((uint32)n) + PopCount32((uint32)(n >> 32));
+}
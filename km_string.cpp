@@ -1,6 +1,6 @@
 #include "km_string.h"
 
-#include <ctype.h>
+#include <stdlib.h>
 #include <stb_sprintf.h>
 #define UTF8PROC_STATIC
 #ifdef KM_UTF8
@@ -8,6 +8,9 @@
 #endif
 
 #include "km_math.h"
+#include "km_pow10_table.h"
+#include "km_pow5_table.h"
+#include "km_simd.h"
 
 uint32 StringLength(const char* str)
 {
@@ -91,17 +94,7 @@ int StringCompare(const_string str1, const_string str2)
 
 bool StringEquals(const_string str1, const_string str2)
 {
-    if (str1.size != str2.size) {
-        return false;
-    }
-
-    for (uint32 i = 0; i < str1.size; i++) {
-        if (str1[i] != str2[i]) {
-            return false;
-        }
-    }
-
-    return true;
+    return str1.Equals(str2);
 }
 
 void CatStrings(size_t sourceACount, const char* sourceA,
@@ -119,315 +112,2639 @@ void CatStrings(size_t sourceACount, const char* sourceA,
         *dest++ = *sourceB++;
     }
 
-    *dest++ = '\0';
+    *dest++ = '\0';
+}
+
+void StringCat(const char* str1, const char* str2, char* dest, uint32 destMaxLength)
+{
+    CatStrings(StringLength(str1), str1, StringLength(str2), str2, destMaxLength, dest);
+}
+
+// Past this many bytes of verification work (beyond 4 per byte scanned), the first/last byte filter
+// is hitting too many false candidates, and the search switches to two-way
+const uint64 SUBSTRING_SEARCH_VERIFY_SLACK = 4096;
+
+// Crochemore-Perrin two-way string matching: linear time and constant space for any needle.
+// With REVERSE, both strings are read back to front, so the result is the last match, counted from
+// the end of str. Returns strSize if there is no match.
+template <bool REVERSE>
+struct TwoWayText
+{
+    const char* data;
+    int64 size;
+
+    inline char operator[](int64 index) const
+    {
+        return REVERSE ? data[size - 1 - index] : data[index];
+    }
+};
+
+template <bool REVERSE>
+internal int64 TwoWayMaxSuffix(TwoWayText<REVERSE> x, bool flipOrder, int64* outPeriod)
+{
+    int64 maxSuffix = -1;
+    int64 j = 0;
+    int64 k = 1;
+    int64 period = 1;
+    while (j + k < x.size) {
+        const uint8 a = (uint8)x[j + k];
+        const uint8 b = (uint8)x[maxSuffix + k];
+        if (flipOrder ? a > b : a < b) {
+            j += k;
+            k = 1;
+            period = j - maxSuffix;
+        }
+        else if (a == b) {
+            if (k != period) {
+                k++;
+            }
+            else {
+                j += period;
+                k = 1;
+            }
+        }
+        else {
+            maxSuffix = j;
+            j = maxSuffix + 1;
+            k = 1;
+            period = 1;
+        }
+    }
+
+    *outPeriod = period;
+    return maxSuffix;
+}
+
+template <bool REVERSE>
+internal uint32 SubstringSearchTwoWay(const char* str, uint32 strSize, const char* substr, uint32 substrSize)
+{
+    const TwoWayText<REVERSE> y = { .data = str, .size = strSize };
+    const TwoWayText<REVERSE> x = { .data = substr, .size = substrSize };
+    const int64 n = y.size;
+    const int64 m = x.size;
+
+    // Critical factorization x = x[0..ell] x[ell+1..m-1]
+    int64 period1, period2;
+    const int64 suffix1 = TwoWayMaxSuffix(x, false, &period1);
+    const int64 suffix2 = TwoWayMaxSuffix(x, true, &period2);
+    const int64 ell = suffix1 > suffix2 ? suffix1 : suffix2;
+    int64 period = suffix1 > suffix2 ? period1 : period2;
+
+    bool periodic = ell + 1 + period <= m;
+    for (int64 i = 0; periodic && i <= ell; i++) {
+        periodic = x[i] == x[i + period];
+    }
+
+    int64 j = 0;
+    if (periodic) {
+        int64 memory = -1;
+        while (j <= n - m) {
+            int64 i = (ell > memory ? ell : memory) + 1;
+            while (i < m && x[i] == y[i + j]) {
+                i++;
+            }
+            if (i >= m) {
+                i = ell;
+                while (i > memory && x[i] == y[i + j]) {
+                    i--;
+                }
+                if (i <= memory) {
+                    return (uint32)j;
+                }
+                j += period;
+                memory = m - period - 1;
+            }
+            else {
+                j += i - ell;
+                memory = -1;
+            }
+        }
+    }
+    else {
+        const int64 left = ell + 1;
+        const int64 right = m - ell - 1;
+        period = (left > right ? left : right) + 1;
+        while (j <= n - m) {
+            int64 i = ell + 1;
+            while (i < m && x[i] == y[i + j]) {
+                i++;
+            }
+            if (i >= m) {
+                i = ell;
+                while (i >= 0 && x[i] == y[i + j]) {
+                    i--;
+                }
+                if (i < 0) {
+                    return (uint32)j;
+                }
+                j += period;
+            }
+            else {
+                j += i - ell;
+            }
+        }
+    }
+
+    return strSize;
+}
+
+// Candidates are positions where both the first and the last byte of substr match, found 16 at a
+// time with SSE2, then verified with MemComp. Single-byte searches go through Array::FindFirst.
+uint32 SubstringSearch(const_string str, const_string substr, uint32 start)
+{
+    DEBUG_ASSERT(start <= str.size);
+
+    if (substr.size == 0) {
+        return start;
+    }
+    if (substr.size > str.size - start) {
+        return str.size;
+    }
+    if (substr.size == 1) {
+        return str.FindFirst(substr[0], start);
+    }
+
+    const char* s = str.data + start;
+    const uint32 n = str.size - start;
+    const uint32 m = substr.size;
+    uint32 i = 0;
+
+#if KM_SIMD_SSE2
+    const __m128i first = _mm_set1_epi8(substr.data[0]);
+    const __m128i last = _mm_set1_epi8(substr.data[m - 1]);
+    uint64 verifiedBytes = 0;
+    for (; n - i >= m - 1 + 16; i += 16) {
+        const __m128i blockFirst = _mm_loadu_si128((const __m128i*)(s + i));
+        const __m128i blockLast = _mm_loadu_si128((const __m128i*)(s + i + m - 1));
+        uint32 mask = (uint32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                              _mm_cmpeq_epi8(blockLast, last)));
+        while (mask != 0) {
+            const uint32 bit = CountTrailingZeros32(mask);
+            if (MemComp(s + i + bit + 1, substr.data + 1, m - 2) == 0) {
+                return start + i + bit;
+            }
+            verifiedBytes += m;
+            mask &= mask - 1;
+        }
+
+        if (verifiedBytes > SUBSTRING_SEARCH_VERIFY_SLACK + 4 * (uint64)i) {
+            const uint32 result = SubstringSearchTwoWay<false>(s + i, n - i, substr.data, m);
+            return result == n - i ? str.size : start + i + result;
+        }
+    }
+#endif
+
+    for (; i <= n - m; i++) {
+        if (s[i] == substr.data[0] && MemComp(s + i + 1, substr.data + 1, m - 1) == 0) {
+            return start + i;
+        }
+    }
+
+    return str.size;
+}
+
+uint32 SubstringSearchLast(const_string str, const_string substr)
+{
+    if (substr.size == 0 || substr.size > str.size) {
+        return str.size;
+    }
+    if (substr.size == 1) {
+        return str.FindLast(substr[0]);
+    }
+
+    const char* s = str.data;
+    const uint32 m = substr.size;
+    // Number of candidate positions left to check, they are [0, end)
+    uint32 end = str.size - m + 1;
+
+#if KM_SIMD_SSE2
+    const __m128i first = _mm_set1_epi8(substr.data[0]);
+    const __m128i last = _mm_set1_epi8(substr.data[m - 1]);
+    uint64 verifiedBytes = 0;
+    for (; end >= 16; end -= 16) {
+        const uint32 i = end - 16;
+        const __m128i blockFirst = _mm_loadu_si128((const __m128i*)(s + i));
+        const __m128i blockLast = _mm_loadu_si128((const __m128i*)(s + i + m - 1));
+        uint32 mask = (uint32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                              _mm_cmpeq_epi8(blockLast, last)));
+        while (mask != 0) {
+            const uint32 bit = HighestSetBit32(mask);
+            if (MemComp(s + i + bit + 1, substr.data + 1, m - 2) == 0) {
+                return i + bit;
+            }
+            verifiedBytes += m;
+            mask &= ~(1u << bit);
+        }
+
+        const uint64 scanned = str.size - m + 1 - i;
+        if (verifiedBytes > SUBSTRING_SEARCH_VERIFY_SLACK + 4 * scanned) {
+            const uint32 prefixSize = i + m - 1;
+            const uint32 result = SubstringSearchTwoWay<true>(s, prefixSize, substr.data, m);
+            return result == prefixSize ? str.size : prefixSize - m - result;
+        }
+    }
+#endif
+
+    while (end > 0) {
+        end--;
+        if (s[end] == substr.data[0] && MemComp(s + end + 1, substr.data + 1, m - 1) == 0) {
+            return end;
+        }
+    }
+
+    return str.size;
+}
+
+template <typename Allocator>
+void SubstringSearchAll(const_string str, const_string substr, DynamicArray<uint32, Allocator>* outIndices)
+{
+    DEBUG_ASSERT(substr.size > 0);
+    outIndices->Clear();
+
+    uint32 start = 0;
+    while (start <= str.size) {
+        const uint32 index = SubstringSearch(str, substr, start);
+        if (index == str.size) {
+            break;
+        }
+        outIndices->Append(index);
+        start = index + substr.size;
+    }
+}
+
+bool StringContains(const_string str, const_string substr)
+{
+    return SubstringSearch(str, substr) != str.size;
+}
+
+// ASCII character classes, one table lookup instead of branches or locale-aware ctype calls
+enum CharClassFlags : uint8
+{
+    CHAR_CLASS_NEWLINE    = 1 << 0,
+    CHAR_CLASS_WHITESPACE = 1 << 1,
+    CHAR_CLASS_DIGIT      = 1 << 2,
+    CHAR_CLASS_UPPERCASE  = 1 << 3,
+    CHAR_CLASS_LOWERCASE  = 1 << 4,
+
+    CHAR_CLASS_ALPHANUMERIC = CHAR_CLASS_DIGIT | CHAR_CLASS_UPPERCASE | CHAR_CLASS_LOWERCASE
+};
+
+struct CharClassTable
+{
+    uint8 flags[256];
+};
+
+internal constexpr CharClassTable BuildCharClassTable()
+{
+    CharClassTable table = {};
+    table.flags['\n'] |= CHAR_CLASS_NEWLINE;
+    table.flags['\r'] |= CHAR_CLASS_NEWLINE;
+    const char whitespace[] = " \t\n\v\f\r";
+    for (int i = 0; whitespace[i] != '\0'; i++) {
+        table.flags[(uint8)whitespace[i]] |= CHAR_CLASS_WHITESPACE;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        table.flags[c] |= CHAR_CLASS_DIGIT;
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        table.flags[c] |= CHAR_CLASS_UPPERCASE;
+        table.flags[c + ('a' - 'A')] |= CHAR_CLASS_LOWERCASE;
+    }
+    return table;
+}
+
+global_var constexpr CharClassTable CHAR_CLASSES = BuildCharClassTable();
+
+inline bool IsNewline(char c)
+{
+    return (CHAR_CLASSES.flags[(uint8)c] & CHAR_CLASS_NEWLINE) != 0;
+}
+
+inline bool IsWhitespace(char c)
+{
+    return (CHAR_CLASSES.flags[(uint8)c] & CHAR_CLASS_WHITESPACE) != 0;
+}
+
+inline bool IsAlphanumeric(char c)
+{
+    return (CHAR_CLASSES.flags[(uint8)c] & CHAR_CLASS_ALPHANUMERIC) != 0;
+}
+
+inline char ToLowercaseAscii(char c)
+{
+    return (CHAR_CLASSES.flags[(uint8)c] & CHAR_CLASS_UPPERCASE) ? c | 0x20 : c;
+}
+
+inline char ToUppercaseAscii(char c)
+{
+    return (CHAR_CLASSES.flags[(uint8)c] & CHAR_CLASS_LOWERCASE) ? c & ~0x20 : c;
+}
+
+#if KM_SIMD_SSE2
+// Lanes set to 0xFF for ' ', '\t', '\n', '\v', '\f' and '\r'. The last 5 are the range [9, 13],
+// bytes >= 0x80 are negative as int8 so the signed range compare excludes them.
+internal inline __m128i SimdWhitespaceMask(__m128i chars)
+{
+    const __m128i inRange = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('\t' - 1)),
+                                          _mm_cmplt_epi8(chars, _mm_set1_epi8('\r' + 1)));
+    return _mm_or_si128(inRange, _mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')));
+}
+
+// Lanes with 'A' to 'Z' get the 0x20 lowercase bit set
+internal inline __m128i SimdToLowercaseAscii(__m128i chars)
+{
+    const __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)),
+                                          _mm_cmplt_epi8(chars, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(chars, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+// First index at or after start whose whitespace-ness isn't WHITESPACE
+template <bool WHITESPACE>
+internal uint32 FindWhitespaceClass(const_string str, uint32 start)
+{
+    uint32 i = start;
+#if KM_SIMD_SSE2
+    for (; str.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(str.data + i));
+        uint32 mask = (uint32)_mm_movemask_epi8(SimdWhitespaceMask(chars));
+        if (WHITESPACE) {
+            mask ^= 0xFFFF;
+        }
+        if (mask != 0) {
+            return i + CountTrailingZeros32(mask);
+        }
+    }
+#endif
+
+    while (i < str.size && IsWhitespace(str.data[i]) == WHITESPACE) {
+        i++;
+    }
+    return i;
+}
+
+uint32 SkipWhitespace(const_string str, uint32 start)
+{
+    DEBUG_ASSERT(start <= str.size);
+    return FindWhitespaceClass<true>(str, start);
+}
+
+uint32 FindWhitespace(const_string str, uint32 start)
+{
+    DEBUG_ASSERT(start <= str.size);
+    return FindWhitespaceClass<false>(str, start);
+}
+
+string TrimWhitespace(const_string str)
+{
+    const uint32 start = SkipWhitespace(str);
+    uint32 end = str.size;
+    while (end > start && IsWhitespace(str[end - 1])) {
+        end--;
+    }
+
+    return string {
+        .size = end - start,
+        .data = (char*)str.data + start
+    };
+}
+
+bool StringEqualsIgnoreCase(const_string str1, const_string str2)
+{
+    if (str1.size != str2.size) {
+        return false;
+    }
+
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    for (; str1.size - i >= 16; i += 16) {
+        const __m128i chars1 = SimdToLowercaseAscii(_mm_loadu_si128((const __m128i*)(str1.data + i)));
+        const __m128i chars2 = SimdToLowercaseAscii(_mm_loadu_si128((const __m128i*)(str2.data + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(chars1, chars2)) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < str1.size; i++) {
+        if (ToLowercaseAscii(str1.data[i]) != ToLowercaseAscii(str2.data[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32 StringHashIgnoreCase(const_string str)
+{
+    uint32 hash = 5381;
+    for (uint32 i = 0; i < str.size; i++) {
+        hash = ((hash << 5) + hash) + ToLowercaseAscii(str.data[i]);
+    }
+    return hash;
+}
+
+// SWAR digit helpers, on 8 characters loaded little-endian into a uint64
+internal inline uint64 LoadEightChars(const char* str)
+{
+    uint64 chars;
+    MemCopy(&chars, str, sizeof(chars));
+    return chars;
+}
+
+internal inline bool IsEightDigits(uint64 chars)
+{
+    // Any byte below '0' borrows in the subtraction, any byte above '9' carries in the addition
+    return (((chars + 0x4646464646464646ULL) | (chars - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0;
+}
+
+internal inline uint32 ParseEightDigits(uint64 chars)
+{
+    // Combine adjacent digits into 2-digit, then 4-digit, then 8-digit values
+    chars -= 0x3030303030303030ULL;
+    chars = (chars * 10) + (chars >> 8);
+    chars = (((chars & 0x000000FF000000FFULL) * 0x000F424000000064ULL)
+             + (((chars >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+    return (uint32)chars;
+}
+
+internal inline bool IsDigit(char c)
+{
+    return (uint8)(c - '0') < 10;
+}
+
+// Bytes of chars strictly between low and high get their top bit set, others get 0. Needs high <= 128.
+internal inline uint64 BytesBetween(uint64 chars, uint8 low, uint8 high)
+{
+    const uint64 ONES = 0x0101010101010101ULL;
+    const uint64 low7 = chars & (ONES * 127);
+    return ((ONES * (127 + high) - low7) & ~chars & (low7 + ONES * (127 - low))) & (ONES * 128);
+}
+
+internal inline bool IsEightHexDigits(uint64 chars)
+{
+    const uint64 digits = BytesBetween(chars, '0' - 1, '9' + 1);
+    const uint64 letters = BytesBetween(chars | 0x2020202020202020ULL, 'a' - 1, 'f' + 1);
+    return (digits | letters) == 0x8080808080808080ULL;
+}
+
+internal inline uint32 ParseEightHexDigits(uint64 chars)
+{
+    // Character to nibble: '0'-'9' are 0x3X, letters 0x4X/0x6X and need 9 added to their low bits
+    uint64 nibbles = (chars & 0x0F0F0F0F0F0F0F0FULL) + ((chars >> 6) & 0x0101010101010101ULL) * 9;
+    // First character is the most significant, so pack byte pairs, then 16-bit pairs, then 32-bit
+    nibbles = ((nibbles << 4) | (nibbles >> 8)) & 0x00FF00FF00FF00FFULL;
+    nibbles = ((nibbles << 8) | (nibbles >> 16)) & 0x0000FFFF0000FFFFULL;
+    nibbles = ((nibbles << 16) | (nibbles >> 32)) & 0x00000000FFFFFFFFULL;
+    return (uint32)nibbles;
+}
+
+internal inline uint32 HexDigitValue(char c)
+{
+    if (IsDigit(c)) {
+        return (uint32)(c - '0');
+    }
+    const char lower = c | 0x20;
+    if (lower >= 'a' && lower <= 'f') {
+        return (uint32)(lower - 'a' + 10);
+    }
+    return 16;
+}
+
+// Parses [p, end) as digits only, at least 1, failing if the value is over maxValue
+internal bool ParseUIntBase10(const char* p, const char* end, uint64 maxValue, uint64* outValue)
+{
+    if (p == end) {
+        return false;
+    }
+    while (end - p > 1 && *p == '0') {
+        p++;
+    }
+    // UINT64_MAX has 20 digits, so the first 19 can't overflow
+    if (end - p > 20) {
+        return false;
+    }
+    const char* noOverflowEnd = end - p > 19 ? p + 19 : end;
+
+    uint64 value = 0;
+    while (noOverflowEnd - p >= 8) {
+        const uint64 chars = LoadEightChars(p);
+        if (!IsEightDigits(chars)) {
+            return false;
+        }
+        value = value * 100000000 + ParseEightDigits(chars);
+        p += 8;
+    }
+    for (; p != noOverflowEnd; p++) {
+        if (!IsDigit(*p)) {
+            return false;
+        }
+        value = value * 10 + (uint64)(*p - '0');
+    }
+    if (p != end) {
+        if (!IsDigit(*p)) {
+            return false;
+        }
+        const uint64 digit = (uint64)(*p - '0');
+        if (value > (UINT64_MAX_VALUE - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+
+    if (value > maxValue) {
+        return false;
+    }
+    *outValue = value;
+    return true;
+}
+
+internal bool ParseUIntBase16(const char* p, const char* end, uint64 maxValue, uint64* outValue)
+{
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    if (p == end) {
+        return false;
+    }
+    while (end - p > 1 && *p == '0') {
+        p++;
+    }
+    if (end - p > 16) {
+        return false;
+    }
+
+    uint64 value = 0;
+    while (end - p >= 8) {
+        const uint64 chars = LoadEightChars(p);
+        if (!IsEightHexDigits(chars)) {
+            return false;
+        }
+        value = (value << 32) | ParseEightHexDigits(chars);
+        p += 8;
+    }
+    for (; p != end; p++) {
+        const uint32 digit = HexDigitValue(*p);
+        if (digit >= 16) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+
+    if (value > maxValue) {
+        return false;
+    }
+    *outValue = value;
+    return true;
+}
+
+// Sign, then the magnitude limited to what fits in a signed integer with the given max
+internal bool ParseIntBase10(const_string str, uint64 maxPositive, int64* outValue)
+{
+    const char* p = str.data;
+    const char* end = str.data + str.size;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64 magnitude;
+    if (!ParseUIntBase10(p, end, negative ? maxPositive + 1 : maxPositive, &magnitude)) {
+        return false;
+    }
+    *outValue = negative ? (int64)(0 - magnitude) : (int64)magnitude;
+    return true;
+}
+
+bool StringToIntBase10(const_string str, int* intBase10)
+{
+    int64 value;
+    if (!ParseIntBase10(str, INT32_MAX_VALUE, &value)) {
+        return false;
+    }
+    *intBase10 = (int)value;
+    return true;
+}
+
+bool StringToInt64Base10(const_string str, int64* intBase10)
+{
+    return ParseIntBase10(str, 0x7FFFFFFFFFFFFFFFULL, intBase10);
+}
+
+bool StringToUInt32Base10(const_string str, uint32* intBase10)
+{
+    uint64 value;
+    if (!ParseUIntBase10(str.data, str.data + str.size, UINT32_MAX_VALUE, &value)) {
+        return false;
+    }
+    *intBase10 = (uint32)value;
+    return true;
+}
+
+bool StringToUInt64Base10(const_string str, uint64* intBase10)
+{
+    return ParseUIntBase10(str.data, str.data + str.size, UINT64_MAX_VALUE, intBase10);
+}
+
+bool StringToUInt32Base16(const_string str, uint32* intBase16)
+{
+    uint64 value;
+    if (!ParseUIntBase16(str.data, str.data + str.size, UINT32_MAX_VALUE, &value)) {
+        return false;
+    }
+    *intBase16 = (uint32)value;
+    return true;
+}
+
+bool StringToUInt64Base16(const_string str, uint64* intBase16)
+{
+    return ParseUIntBase16(str.data, str.data + str.size, UINT64_MAX_VALUE, intBase16);
+}
+
+// Parameters of IEEE 754 binary formats for the float parser below
+struct Float32Format
+{
+    using Type = float32;
+    using Bits = uint32;
+
+    static const int32 MANTISSA_BITS = 23;
+    static const int32 MIN_EXPONENT = -127;
+    static const int32 INFINITE_POWER = 0xFF;
+    static const int32 SIGN_BIT = 31;
+    // Decimal exponents beyond these always give 0 or infinity
+    static const int32 MIN_POWER_10 = -65;
+    static const int32 MAX_POWER_10 = 38;
+    // Only here can a product be exactly halfway between two floats
+    static const int32 ROUND_TO_EVEN_MIN_POWER_10 = -17;
+    static const int32 ROUND_TO_EVEN_MAX_POWER_10 = 10;
+    // Clinger's fast path: mantissa and power of 10 both exact, so one rounding in the multiply
+    static const int32 FAST_PATH_MAX_POWER_10 = 10;
+    static const uint64 FAST_PATH_MAX_MANTISSA = 1ULL << 24;
+};
+
+struct Float64Format
+{
+    using Type = float64;
+    using Bits = uint64;
+
+    static const int32 MANTISSA_BITS = 52;
+    static const int32 MIN_EXPONENT = -1023;
+    static const int32 INFINITE_POWER = 0x7FF;
+    static const int32 SIGN_BIT = 63;
+    static const int32 MIN_POWER_10 = -342;
+    static const int32 MAX_POWER_10 = 308;
+    static const int32 ROUND_TO_EVEN_MIN_POWER_10 = -4;
+    static const int32 ROUND_TO_EVEN_MAX_POWER_10 = 23;
+    static const int32 FAST_PATH_MAX_POWER_10 = 22;
+    static const uint64 FAST_PATH_MAX_MANTISSA = 1ULL << 53;
+};
+
+static const float32 FLOAT32_EXACT_POWERS_10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+static const float64 FLOAT64_EXACT_POWERS_10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+internal inline float32 ExactPowerOf10(int32 power, float32)
+{
+    return FLOAT32_EXACT_POWERS_10[power];
+}
+internal inline float64 ExactPowerOf10(int32 power, float64)
+{
+    return FLOAT64_EXACT_POWERS_10[power];
+}
+
+internal inline uint64 Multiply128(uint64 a, uint64 b, uint64* outHigh)
+{
+#if defined(_MSC_VER)
+    return _umul128(a, b, outHigh);
+#else
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    *outHigh = (uint64)(product >> 64);
+    return (uint64)product;
+#endif
+}
+
+// Decimal number as mantissa * 10^exponent, from the syntax accepted by StringToFloat32/64
+struct ParsedDecimal
+{
+    uint64 mantissa;
+    int64 exponent;
+    bool negative;
+    // More than 19 significant digits: mantissa holds the first 19, and the value is in between
+    // mantissa and mantissa + 1 (times 10^exponent)
+    bool truncated;
+};
+
+internal bool ParseDecimal(const_string str, ParsedDecimal* outDecimal)
+{
+    const char* p = str.data;
+    const char* end = str.data + str.size;
+
+    outDecimal->negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        outDecimal->negative = *p == '-';
+        p++;
+    }
+
+    uint64 mantissa = 0;
+    const char* integerStart = p;
+    while (end - p >= 8 && IsEightDigits(LoadEightChars(p))) {
+        mantissa = mantissa * 100000000 + ParseEightDigits(LoadEightChars(p));
+        p += 8;
+    }
+    while (p != end && IsDigit(*p)) {
+        mantissa = mantissa * 10 + (uint64)(*p - '0');
+        p++;
+    }
+    const char* integerEnd = p;
+    int64 numDigits = integerEnd - integerStart;
+
+    int64 exponent = 0;
+    const char* fractionStart = p;
+    const char* fractionEnd = p;
+    if (p != end && *p == '.') {
+        p++;
+        fractionStart = p;
+        while (end - p >= 8 && IsEightDigits(LoadEightChars(p))) {
+            mantissa = mantissa * 100000000 + ParseEightDigits(LoadEightChars(p));
+            p += 8;
+        }
+        while (p != end && IsDigit(*p)) {
+            mantissa = mantissa * 10 + (uint64)(*p - '0');
+            p++;
+        }
+        fractionEnd = p;
+        exponent = -(fractionEnd - fractionStart);
+        numDigits += fractionEnd - fractionStart;
+    }
+    if (numDigits == 0) {
+        return false;
+    }
+
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exponentNegative = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            exponentNegative = *p == '-';
+            p++;
+        }
+        if (p == end || !IsDigit(*p)) {
+            return false;
+        }
+        int64 exponentValue = 0;
+        while (p != end && IsDigit(*p)) {
+            // Saturate, anything this big is 0 or infinity anyway
+            if (exponentValue < 0x10000000) {
+                exponentValue = exponentValue * 10 + (*p - '0');
+            }
+            p++;
+        }
+        exponent += exponentNegative ? -exponentValue : exponentValue;
+    }
+    if (p != end) {
+        return false;
+    }
+
+    outDecimal->truncated = false;
+    if (numDigits > 19) {
+        // Leading zeros don't count, and mantissa overflowed only if there are still too many digits
+        for (const char* c = integerStart; c != end && (*c == '0' || *c == '.'); c++) {
+            if (*c == '0') {
+                numDigits--;
+            }
+        }
+        if (numDigits > 19) {
+            const uint64 MIN_19_DIGITS = 1000000000000000000ULL;
+            outDecimal->truncated = true;
+            mantissa = 0;
+            const char* c = integerStart;
+            while (mantissa < MIN_19_DIGITS && c != integerEnd) {
+                mantissa = mantissa * 10 + (uint64)(*c - '0');
+                c++;
+            }
+            if (mantissa >= MIN_19_DIGITS) {
+                exponent = (integerEnd - c) + (exponent + (fractionEnd - fractionStart));
+            }
+            else {
+                c = fractionStart;
+                while (mantissa < MIN_19_DIGITS && c != fractionEnd) {
+                    mantissa = mantissa * 10 + (uint64)(*c - '0');
+                    c++;
+                }
+                exponent = (fractionStart - c) + (exponent + (fractionEnd - fractionStart));
+            }
+        }
+    }
+
+    outDecimal->mantissa = mantissa;
+    outDecimal->exponent = exponent;
+    return true;
+}
+
+struct BinaryFloat
+{
+    uint64 mantissa;
+    int32 power2; // biased exponent
+};
+
+// Eisel-Lemire: correctly rounded w * 10^q, from a 128-bit approximation of 5^q. Always exact for a
+// 64-bit w ( source https://arxiv.org/abs/2101.11408 and https://arxiv.org/abs/2212.06644 )
+template <typename Format>
+internal BinaryFloat EiselLemire(int64 q, uint64 w)
+{
+    BinaryFloat result;
+    if (w == 0 || q < Format::MIN_POWER_10) {
+        result.mantissa = 0;
+        result.power2 = 0;
+        return result;
+    }
+    if (q > Format::MAX_POWER_10) {
+        result.mantissa = 0;
+        result.power2 = Format::INFINITE_POWER;
+        return result;
+    }
+
+    const int32 leadingZeros = 63 - (int32)HighestSetBit64(w);
+    w <<= leadingZeros;
+
+    // Only the top MANTISSA_BITS + 3 bits of the product matter, the second half of the 5^q
+    // approximation is needed only when those could still change
+    const uint32 tableIndex = 2 * (uint32)(q - POW5_TABLE_MIN_EXPONENT);
+    const uint64 precisionMask = 0xFFFFFFFFFFFFFFFFULL >> (Format::MANTISSA_BITS + 3);
+    uint64 productHigh;
+    uint64 productLow = Multiply128(w, POW5_TABLE_128[tableIndex], &productHigh);
+    if ((productHigh & precisionMask) == precisionMask) {
+        uint64 secondHigh;
+        Multiply128(w, POW5_TABLE_128[tableIndex + 1], &secondHigh);
+        productLow += secondHigh;
+        if (secondHigh > productLow) {
+            productHigh++;
+        }
+    }
+
+    const int32 upperBit = (int32)(productHigh >> 63);
+    const int32 shift = upperBit + 64 - Format::MANTISSA_BITS - 3;
+    result.mantissa = productHigh >> shift;
+    // floor(log2(10^q)) + 63, as a fixed-point multiply
+    const int32 power2OfPower10 = (int32)((((152170 + 65536) * q) >> 16) + 63);
+    result.power2 = power2OfPower10 + upperBit - leadingZeros - Format::MIN_EXPONENT;
+
+    if (result.power2 <= 0) {
+        // Subnormal
+        if (-result.power2 + 1 >= 64) {
+            result.mantissa = 0;
+            result.power2 = 0;
+            return result;
+        }
+        result.mantissa >>= -result.power2 + 1;
+        result.mantissa += result.mantissa & 1;
+        result.mantissa >>= 1;
+        result.power2 = result.mantissa < (1ULL << Format::MANTISSA_BITS) ? 0 : 1;
+        return result;
+    }
+
+    // Exactly halfway between two floats: round to even instead of up
+    if (productLow <= 1 && q >= Format::ROUND_TO_EVEN_MIN_POWER_10 && q <= Format::ROUND_TO_EVEN_MAX_POWER_10
+        && (result.mantissa & 3) == 1 && (result.mantissa << shift) == productHigh) {
+        result.mantissa &= ~1ULL;
+    }
+
+    result.mantissa += result.mantissa & 1;
+    result.mantissa >>= 1;
+    if (result.mantissa >= (2ULL << Format::MANTISSA_BITS)) {
+        result.mantissa = 1ULL << Format::MANTISSA_BITS;
+        result.power2++;
+    }
+    result.mantissa &= ~(1ULL << Format::MANTISSA_BITS);
+    if (result.power2 >= Format::INFINITE_POWER) {
+        result.mantissa = 0;
+        result.power2 = Format::INFINITE_POWER;
+    }
+    return result;
+}
+
+template <typename Format>
+internal typename Format::Type BinaryFloatToFloat(BinaryFloat binary, bool negative)
+{
+    typename Format::Bits bits = (typename Format::Bits)(binary.mantissa
+                                                         | ((uint64)binary.power2 << Format::MANTISSA_BITS));
+    if (negative) {
+        bits |= (typename Format::Bits)1 << Format::SIGN_BIT;
+    }
+
+    typename Format::Type f;
+    MemCopy(&f, &bits, sizeof(f));
+    return f;
+}
+
+internal bool StringEqualsIgnoreCaseAscii(const char* str, const char* end, const char* lowercase)
+{
+    for (; str != end; str++, lowercase++) {
+        if (*lowercase == '\0' || (*str | 0x20) != *lowercase) {
+            return false;
+        }
+    }
+    return *lowercase == '\0';
+}
+
+internal bool ParseInfOrNan(const_string str, bool* outNegative, bool* outNan)
+{
+    const char* p = str.data;
+    const char* end = str.data + str.size;
+    *outNegative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        *outNegative = *p == '-';
+        p++;
+    }
+
+    *outNan = StringEqualsIgnoreCaseAscii(p, end, "nan");
+    return *outNan || StringEqualsIgnoreCaseAscii(p, end, "inf")
+        || StringEqualsIgnoreCaseAscii(p, end, "infinity");
+}
+
+// Rare case (truncated mantissa right at a rounding boundary), leave it to the C library
+// NOTE strtod/strtof follow the C locale, so this assumes the process keeps '.' as decimal point
+internal float32 StringToFloatFallback(const char* cString, float32)
+{
+    return strtof(cString, nullptr);
+}
+internal float64 StringToFloatFallback(const char* cString, float64)
+{
+    return strtod(cString, nullptr);
+}
+
+template <typename Format>
+internal bool StringToFloat(const_string str, typename Format::Type* f)
+{
+    using Type = typename Format::Type;
+
+    ParsedDecimal decimal;
+    if (!ParseDecimal(str, &decimal)) {
+        bool negative, nan;
+        if (!ParseInfOrNan(str, &negative, &nan)) {
+            return false;
+        }
+        const BinaryFloat binary = {
+            .mantissa = nan ? (1ULL << (Format::MANTISSA_BITS - 1)) : 0,
+            .power2 = Format::INFINITE_POWER
+        };
+        *f = BinaryFloatToFloat<Format>(binary, negative);
+        return true;
+    }
+
+    if (!decimal.truncated && decimal.mantissa <= Format::FAST_PATH_MAX_MANTISSA
+        && decimal.exponent >= -Format::FAST_PATH_MAX_POWER_10 && decimal.exponent <= Format::FAST_PATH_MAX_POWER_10) {
+        Type value = (Type)decimal.mantissa;
+        if (decimal.exponent < 0) {
+            value = value / ExactPowerOf10((int32)-decimal.exponent, value);
+        }
+        else {
+            value = value * ExactPowerOf10((int32)decimal.exponent, value);
+        }
+        *f = decimal.negative ? -value : value;
+        return true;
+    }
+
+    const BinaryFloat binary = EiselLemire<Format>(decimal.exponent, decimal.mantissa);
+    if (decimal.truncated) {
+        // Digits past the 19th can only matter if mantissa and mantissa + 1 round differently
+        const BinaryFloat binaryUp = EiselLemire<Format>(decimal.exponent, decimal.mantissa + 1);
+        if (binary.mantissa != binaryUp.mantissa || binary.power2 != binaryUp.power2) {
+            const uint32 STACK_BUFFER_SIZE = 512;
+            char stackBuffer[STACK_BUFFER_SIZE];
+            char* cString = stackBuffer;
+            if (str.size >= STACK_BUFFER_SIZE) {
+                cString = (char*)defaultAllocator_.Allocate(str.size + 1);
+                if (cString == nullptr) {
+                    return false;
+                }
+            }
+            MemCopy(cString, str.data, str.size);
+            cString[str.size] = '\0';
+            *f = StringToFloatFallback(cString, (Type)0);
+            if (cString != stackBuffer) {
+                defaultAllocator_.Free(cString);
+            }
+            return true;
+        }
+    }
+
+    *f = BinaryFloatToFloat<Format>(binary, decimal.negative);
+    return true;
+}
+
+bool StringToFloat32(const_string str, float32* f)
+{
+    return StringToFloat<Float32Format>(str, f);
+}
+
+bool StringToFloat64(const_string str, float64* f)
+{
+    return StringToFloat<Float64Format>(str, f);
+}
+
+template <typename Allocator>
+void StringSplit(const_string str, char c, DynamicArray<string, Allocator>* outSplit)
+{
+    outSplit->Clear();
+
+    SplitIterator it(str, c);
+    string element;
+    while (it.Next(&element)) {
+        outSplit->Append(element);
+    }
+}
+
+string NextSplitElement(string* str, char separator)
+{
+    string next = *str;
+    const uint32 separatorIndex = str->FindFirst(separator);
+    if (separatorIndex != str->size) {
+        next.size = separatorIndex;
+        str->size--;
+    }
+
+    str->size -= next.size;
+    str->data += next.size + 1;
+    return next;
+}
+
+// Bit i set if block[i] == separator, for the first min(size, 64) bytes of block
+internal uint64 SeparatorMask64(const char* block, uint32 size, char separator)
+{
+    uint64 mask = 0;
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    if (size >= 64) {
+        const __m128i needle = _mm_set1_epi8(separator);
+        const uint64 m0 = (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)block), needle));
+        const uint64 m1 = (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(block + 16)), needle));
+        const uint64 m2 = (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(block + 32)), needle));
+        const uint64 m3 = (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(block + 48)), needle));
+        return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+    }
+#endif
+
+    const uint32 n = size < 64 ? size : 64;
+    for (; i < n; i++) {
+        mask |= (uint64)(block[i] == separator) << i;
+    }
+    return mask;
+}
+
+SplitIterator::SplitIterator(const_string str, char separator)
+    : data(str.data), size(str.size), elementStart(0), blockStart(0), separator(separator), done(false)
+{
+    separatorMask = SeparatorMask64(data, size, separator);
+}
+
+bool SplitIterator::Next(string* outElement)
+{
+    if (done) {
+        return false;
+    }
+
+    while (separatorMask == 0) {
+        if (size - blockStart <= 64) {
+            // No separators left, the rest of the string is the last element
+            outElement->data = (char*)data + elementStart;
+            outElement->size = size - elementStart;
+            done = true;
+            return true;
+        }
+        blockStart += 64;
+        separatorMask = SeparatorMask64(data + blockStart, size - blockStart, separator);
+    }
+
+    const uint32 separatorIndex = blockStart + CountTrailingZeros64(separatorMask);
+    separatorMask &= separatorMask - 1;
+
+    outElement->data = (char*)data + elementStart;
+    outElement->size = separatorIndex - elementStart;
+    elementStart = separatorIndex + 1;
+    return true;
+}
+
+LineIterator::LineIterator(const_string str)
+    : split(str, '\n')
+{
+}
+
+bool LineIterator::Next(string* outLine)
+{
+    if (!split.Next(outLine)) {
+        return false;
+    }
+    if (split.done && outLine->size == 0) {
+        // Nothing after the last newline
+        return false;
+    }
+
+    if (outLine->size > 0 && outLine->data[outLine->size - 1] == '\r') {
+        outLine->size--;
+    }
+    return true;
+}
+
+template <typename Allocator>
+string StringConcatenate(const_string str1, const_string str2, Allocator* allocator)
+{
+    string result;
+    result.size = str1.size + str2.size;
+    result.data = allocator->New<char>(result.size);
+    if (result.data == nullptr) {
+        return string::empty;
+    }
+    MemCopy(result.data, str1.data, str1.size);
+    MemCopy(result.data + str1.size, str2.data, str2.size);
+    return result;
+}
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+uint32 FormatUInt(uint64 value, char* buffer)
+{
+    // Digits are produced last to first, 2 at a time
+    char digits[FORMAT_INT_MAX_LENGTH];
+    char* p = digits + FORMAT_INT_MAX_LENGTH;
+    while (value >= 100) {
+        const uint32 pair = (uint32)(value % 100) * 2;
+        value /= 100;
+        *(--p) = DIGIT_PAIRS[pair + 1];
+        *(--p) = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        const uint32 pair = (uint32)value * 2;
+        *(--p) = DIGIT_PAIRS[pair + 1];
+        *(--p) = DIGIT_PAIRS[pair];
+    }
+    else {
+        *(--p) = (char)('0' + value);
+    }
+
+    const uint32 length = (uint32)(digits + FORMAT_INT_MAX_LENGTH - p);
+    MemCopy(buffer, p, length);
+    return length;
+}
+
+uint32 FormatInt(int64 value, char* buffer)
+{
+    if (value < 0) {
+        buffer[0] = '-';
+        return 1 + FormatUInt(0 - (uint64)value, buffer + 1);
+    }
+    return FormatUInt((uint64)value, buffer);
+}
+
+uint32 FormatHex(uint64 value, char* buffer, uint32 minDigits)
+{
+    DEBUG_ASSERT(minDigits <= 16);
+
+    uint32 numDigits = value == 0 ? 1 : HighestSetBit64(value) / 4 + 1;
+    if (numDigits < minDigits) {
+        numDigits = minDigits;
+    }
+    for (uint32 i = numDigits; i > 0; i--) {
+        buffer[i - 1] = "0123456789abcdef"[value & 0xF];
+        value >>= 4;
+    }
+    return numDigits;
+}
+
+// floor(log10(2^e)), floor(log10(3/4 2^e)) and floor(log2(10^e)), as fixed-point multiplies
+internal inline int32 FloorLog10Pow2(int32 e)
+{
+    return (int32)(((int64)e * 661971961083LL) >> 41);
+}
+internal inline int32 FloorLog10ThreeQuartersPow2(int32 e)
+{
+    return (int32)(((int64)e * 661971961083LL - 274743187321LL) >> 41);
+}
+internal inline int32 FloorLog2Pow10(int32 e)
+{
+    return (int32)(((int64)e * 217706) >> 16);
+}
+
+internal inline uint64 MultiplyHigh64(uint64 a, uint64 b)
+{
+    uint64 high;
+    Multiply128(a, b, &high);
+    return high;
+}
+
+// Shortest decimal that parses back to the same float: value = digits * 10^exponent
+struct ShortestDecimal
+{
+    uint64 digits;
+    int32 exponent;
+};
+
+// Rounds (g * cp) 2^-127 to odd, from the 126-bit g = g1 2^63 + g0
+internal inline uint64 SchubfachRoundToOdd64(uint64 g1, uint64 g0, uint64 cp)
+{
+    const uint64 MASK_63 = 0x7FFFFFFFFFFFFFFFULL;
+    const uint64 x1 = MultiplyHigh64(g0, cp);
+    const uint64 y0 = g1 * cp;
+    const uint64 y1 = MultiplyHigh64(g1, cp);
+    const uint64 z = (y0 >> 1) + x1;
+    const uint64 vbp = y1 + (z >> 63);
+    return vbp | (((z & MASK_63) + MASK_63) >> 63);
+}
+
+internal inline uint32 SchubfachRoundToOdd32(uint64 g, uint64 cp)
+{
+    const uint64 MASK_32 = 0xFFFFFFFFULL;
+    const uint64 x1 = MultiplyHigh64(g, cp);
+    const uint64 vbp = x1 >> 31;
+    return (uint32)(vbp | (((x1 & MASK_32) + MASK_32) >> 32));
+}
+
+// Schubfach: among the decimals that round to c 2^q, picks the shortest one, and the closest one
+// among those ( source: R. Giulietti, "The Schubfach way to render doubles" )
+internal ShortestDecimal Schubfach64(int32 q, uint64 c, int32 dk)
+{
+    const uint64 C_MIN = 1ULL << 52;
+    const int32 Q_MIN = -1074;
+
+    const uint64 out = c & 1;
+    const uint64 cb = c << 2;
+    const uint64 cbr = cb + 2;
+    uint64 cbl;
+    int32 k;
+    if (c != C_MIN || q == Q_MIN) {
+        cbl = cb - 2;
+        k = FloorLog10Pow2(q);
+    }
+    else {
+        // Closer lower neighbor at a power of 2
+        cbl = cb - 1;
+        k = FloorLog10ThreeQuartersPow2(q);
+    }
+    const int32 h = q + FloorLog2Pow10(-k) + 2;
+
+    const uint32 tableIndex = 2 * (uint32)(k - POW10_TABLE_MIN_K);
+    const uint64 g1 = POW10_TABLE_G[tableIndex];
+    const uint64 g0 = POW10_TABLE_G[tableIndex + 1];
+
+    const uint64 vb = SchubfachRoundToOdd64(g1, g0, cb << h);
+    const uint64 vbl = SchubfachRoundToOdd64(g1, g0, cbl << h);
+    const uint64 vbr = SchubfachRoundToOdd64(g1, g0, cbr << h);
+
+    const uint64 s = vb >> 2;
+    if (s >= 100) {
+        // Try one digit less first: s rounded down to a multiple of 10, and the next one
+        const uint64 sp10 = 10 * MultiplyHigh64(s, 115292150460684698ULL << 4);
+        const uint64 tp10 = sp10 + 10;
+        const bool upin = vbl + out <= sp10 << 2;
+        const bool wpin = (tp10 << 2) + out <= vbr;
+        if (upin != wpin) {
+            return ShortestDecimal { .digits = upin ? sp10 : tp10, .exponent = k };
+        }
+    }
+
+    const uint64 t = s + 1;
+    const bool uin = vbl + out <= s << 2;
+    const bool win = (t << 2) + out <= vbr;
+    if (uin != win) {
+        return ShortestDecimal { .digits = uin ? s : t, .exponent = k + dk };
+    }
+    const int64 cmp = (int64)vb - (int64)((s + t) << 1);
+    const bool pickS = cmp < 0 || (cmp == 0 && (s & 1) == 0);
+    return ShortestDecimal { .digits = pickS ? s : t, .exponent = k + dk };
+}
+
+internal ShortestDecimal Schubfach32(int32 q, uint32 c, int32 dk)
+{
+    const uint32 C_MIN = 1u << 23;
+    const int32 Q_MIN = -149;
+
+    const uint32 out = c & 1;
+    const uint64 cb = (uint64)c << 2;
+    const uint64 cbr = cb + 2;
+    uint64 cbl;
+    int32 k;
+    if (c != C_MIN || q == Q_MIN) {
+        cbl = cb - 2;
+        k = FloorLog10Pow2(q);
+    }
+    else {
+        cbl = cb - 1;
+        k = FloorLog10ThreeQuartersPow2(q);
+    }
+    const int32 h = q + FloorLog2Pow10(-k) + 33;
+
+    const uint64 g = POW10_TABLE_G[2 * (uint32)(k - POW10_TABLE_MIN_K)] + 1;
+
+    const uint32 vb = SchubfachRoundToOdd32(g, cb << h);
+    const uint32 vbl = SchubfachRoundToOdd32(g, cbl << h);
+    const uint32 vbr = SchubfachRoundToOdd32(g, cbr << h);
+
+    const uint32 s = vb >> 2;
+    if (s >= 100) {
+        const uint32 sp10 = 10 * (uint32)(((uint64)s * 1717986919ULL) >> 34);
+        const uint32 tp10 = sp10 + 10;
+        const bool upin = vbl + out <= sp10 << 2;
+        const bool wpin = (tp10 << 2) + out <= vbr;
+        if (upin != wpin) {
+            return ShortestDecimal { .digits = upin ? sp10 : tp10, .exponent = k };
+        }
+    }
+
+    const uint32 t = s + 1;
+    const bool uin = vbl + out <= s << 2;
+    const bool win = (t << 2) + out <= vbr;
+    if (uin != win) {
+        return ShortestDecimal { .digits = uin ? s : t, .exponent = k + dk };
+    }
+    const int64 cmp = (int64)vb - (int64)((s + t) << 1);
+    const bool pickS = cmp < 0 || (cmp == 0 && (s & 1) == 0);
+    return ShortestDecimal { .digits = pickS ? s : t, .exponent = k + dk };
+}
+
+// Plain notation for decimal exponents in (-7, 21), like JavaScript's number to string, scientific otherwise
+internal uint32 WriteShortestDecimal(ShortestDecimal decimal, bool negative, char* buffer)
+{
+    while (decimal.digits % 10 == 0) {
+        decimal.digits /= 10;
+        decimal.exponent++;
+    }
+
+    char digits[FORMAT_INT_MAX_LENGTH];
+    const int32 numDigits = (int32)FormatUInt(decimal.digits, digits);
+    // Value is 0.digits * 10^point
+    const int32 point = numDigits + decimal.exponent;
+
+    char* p = buffer;
+    if (negative) {
+        *(p++) = '-';
+    }
+
+    if (point > 0 && point <= 21) {
+        if (point >= numDigits) {
+            MemCopy(p, digits, numDigits);
+            p += numDigits;
+            MemSet(p, '0', point - numDigits);
+            p += point - numDigits;
+        }
+        else {
+            MemCopy(p, digits, point);
+            p += point;
+            *(p++) = '.';
+            MemCopy(p, digits + point, numDigits - point);
+            p += numDigits - point;
+        }
+    }
+    else if (point <= 0 && point > -6) {
+        *(p++) = '0';
+        *(p++) = '.';
+        MemSet(p, '0', -point);
+        p += -point;
+        MemCopy(p, digits, numDigits);
+        p += numDigits;
+    }
+    else {
+        *(p++) = digits[0];
+        if (numDigits > 1) {
+            *(p++) = '.';
+            MemCopy(p, digits + 1, numDigits - 1);
+            p += numDigits - 1;
+        }
+        *(p++) = 'e';
+        p += FormatInt(point - 1, p);
+    }
+
+    return (uint32)(p - buffer);
+}
+
+internal uint32 WriteInfOrNan(bool nan, bool negative, char* buffer)
+{
+    if (nan) {
+        MemCopy(buffer, "nan", 3);
+        return 3;
+    }
+    if (negative) {
+        MemCopy(buffer, "-inf", 4);
+        return 4;
+    }
+    MemCopy(buffer, "inf", 3);
+    return 3;
+}
+
+uint32 FormatFloat(float64 value, char* buffer)
+{
+    uint64 bits;
+    MemCopy(&bits, &value, sizeof(bits));
+    const bool negative = (bits >> 63) != 0;
+    const uint32 biasedExponent = (uint32)(bits >> 52) & 0x7FF;
+    const uint64 fraction = bits & ((1ULL << 52) - 1);
+
+    if (biasedExponent == 0x7FF) {
+        return WriteInfOrNan(fraction != 0, negative, buffer);
+    }
+
+    ShortestDecimal decimal;
+    if (biasedExponent != 0) {
+        const int32 minusQ = 1075 - (int32)biasedExponent;
+        const uint64 c = (1ULL << 52) | fraction;
+        // Integers below 2^53 are their own shortest representation
+        if (minusQ > 0 && minusQ < 53 && ((c >> minusQ) << minusQ) == c) {
+            decimal = ShortestDecimal { .digits = c >> minusQ, .exponent = 0 };
+        }
+        else {
+            decimal = Schubfach64(-minusQ, c, 0);
+        }
+    }
+    else if (fraction != 0) {
+        // Subnormal. The smallest ones need an extra digit of precision to be found.
+        decimal = fraction < 3 ? Schubfach64(-1074, 10 * fraction, -1) : Schubfach64(-1074, fraction, 0);
+    }
+    else {
+        if (negative) {
+            MemCopy(buffer, "-0", 2);
+            return 2;
+        }
+        buffer[0] = '0';
+        return 1;
+    }
+
+    return WriteShortestDecimal(decimal, negative, buffer);
+}
+
+uint32 FormatFloat(float32 value, char* buffer)
+{
+    uint32 bits;
+    MemCopy(&bits, &value, sizeof(bits));
+    const bool negative = (bits >> 31) != 0;
+    const uint32 biasedExponent = (bits >> 23) & 0xFF;
+    const uint32 fraction = bits & ((1u << 23) - 1);
+
+    if (biasedExponent == 0xFF) {
+        return WriteInfOrNan(fraction != 0, negative, buffer);
+    }
+
+    ShortestDecimal decimal;
+    if (biasedExponent != 0) {
+        const int32 minusQ = 150 - (int32)biasedExponent;
+        const uint32 c = (1u << 23) | fraction;
+        if (minusQ > 0 && minusQ < 24 && ((c >> minusQ) << minusQ) == c) {
+            decimal = ShortestDecimal { .digits = c >> minusQ, .exponent = 0 };
+        }
+        else {
+            decimal = Schubfach32(-minusQ, c, 0);
+        }
+    }
+    else if (fraction != 0) {
+        decimal = fraction < 8 ? Schubfach32(-149, 10 * fraction, -1) : Schubfach32(-149, fraction, 0);
+    }
+    else {
+        if (negative) {
+            MemCopy(buffer, "-0", 2);
+            return 2;
+        }
+        buffer[0] = '0';
+        return 1;
+    }
+
+    return WriteShortestDecimal(decimal, negative, buffer);
+}
+
+template <uint32 S>
+internal bool FormatAppend(FixedArray<char, S>* outString, const char* data, uint32 size)
+{
+    if (outString->size + size > S) {
+        return false;
+    }
+    MemCopy(outString->data + outString->size, data, size);
+    outString->size += size;
+    return true;
+}
+
+template <typename Allocator>
+internal bool FormatAppend(DynamicArray<char, Allocator>* outString, const char* data, uint32 size)
+{
+    outString->Append(const_string { .size = size, .data = data });
+    return true;
+}
+
+template <typename CharArray>
+bool FormatInt(int64 value, CharArray* outString)
+{
+    char buffer[FORMAT_INT_MAX_LENGTH];
+    return FormatAppend(outString, buffer, FormatInt(value, buffer));
+}
+
+template <typename CharArray>
+bool FormatUInt(uint64 value, CharArray* outString)
+{
+    char buffer[FORMAT_INT_MAX_LENGTH];
+    return FormatAppend(outString, buffer, FormatUInt(value, buffer));
+}
+
+template <typename CharArray>
+bool FormatHex(uint64 value, CharArray* outString, uint32 minDigits)
+{
+    char buffer[FORMAT_HEX_MAX_LENGTH];
+    return FormatAppend(outString, buffer, FormatHex(value, buffer, minDigits));
+}
+
+template <typename CharArray>
+bool FormatFloat(float32 value, CharArray* outString)
+{
+    char buffer[FORMAT_FLOAT_MAX_LENGTH];
+    return FormatAppend(outString, buffer, FormatFloat(value, buffer));
+}
+
+template <typename CharArray>
+bool FormatFloat(float64 value, CharArray* outString)
+{
+    char buffer[FORMAT_FLOAT_MAX_LENGTH];
+    return FormatAppend(outString, buffer, FormatFloat(value, buffer));
+}
+
+// Format arguments, one overload per supported type
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, int32 value)
+{
+    return FormatInt(value, outString);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, int64 value)
+{
+    return FormatInt(value, outString);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, uint32 value)
+{
+    return FormatUInt(value, outString);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, uint64 value)
+{
+    return FormatUInt(value, outString);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, float32 value)
+{
+    return FormatFloat(value, outString);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, float64 value)
+{
+    return FormatFloat(value, outString);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, char value)
+{
+    return FormatAppend(outString, &value, 1);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, bool value)
+{
+    return value ? FormatAppend(outString, "true", 4) : FormatAppend(outString, "false", 5);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, const char* value)
+{
+    return FormatAppend(outString, value, StringLength(value));
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, const_string value)
+{
+    return FormatAppend(outString, value.data, value.size);
+}
+template <typename CharArray>
+internal bool FormatValue(CharArray* outString, const string& value)
+{
+    return FormatAppend(outString, value.data, value.size);
+}
+template <typename CharArray, typename Allocator>
+internal bool FormatValue(CharArray* outString, const DynamicArray<char, Allocator>& value)
+{
+    return FormatAppend(outString, value.data, value.size);
+}
+template <typename CharArray, uint32 S>
+internal bool FormatValue(CharArray* outString, const FixedArray<char, S>& value)
+{
+    return FormatAppend(outString, value.data, value.size);
+}
+
+// Appends format up to the next {} (consumed), or to the end. Returns the rest of the format,
+// or nullptr if a piece didn't fit.
+template <typename CharArray>
+internal const char* FormatLiteral(CharArray* outString, const char* format, bool* outFoundArg)
+{
+    *outFoundArg = false;
+    const char* p = format;
+    while (true) {
+        const char c = *p;
+        if (c == '\0') {
+            return FormatAppend(outString, format, (uint32)(p - format)) ? p : nullptr;
+        }
+        if ((c == '{' && p[1] == '{') || (c == '}' && p[1] == '}')) {
+            // Escaped brace, keep the first one
+            if (!FormatAppend(outString, format, (uint32)(p - format + 1))) {
+                return nullptr;
+            }
+            p += 2;
+            format = p;
+        }
+        else if (c == '{' && p[1] == '}') {
+            *outFoundArg = true;
+            return FormatAppend(outString, format, (uint32)(p - format)) ? p + 2 : nullptr;
+        }
+        else {
+            p++;
+        }
+    }
+}
+
+template <typename CharArray>
+internal bool FormatArgs(CharArray* outString, const char* format)
+{
+    bool foundArg;
+    if (FormatLiteral(outString, format, &foundArg) == nullptr) {
+        return false;
+    }
+    DEBUG_ASSERTF(!foundArg, "Format: more {} than arguments\n");
+    return true;
+}
+
+template <typename CharArray, typename Arg, typename... Args>
+internal bool FormatArgs(CharArray* outString, const char* format, const Arg& arg, const Args&... args)
+{
+    bool foundArg;
+    format = FormatLiteral(outString, format, &foundArg);
+    if (format == nullptr) {
+        return false;
+    }
+    if (!foundArg) {
+        DEBUG_PANIC("Format: more arguments than {}\n");
+        return false;
+    }
+    if (!FormatValue(outString, arg)) {
+        return false;
+    }
+    return FormatArgs(outString, format, args...);
+}
+
+template <typename CharArray, typename... Args>
+bool Format(CharArray* outString, const char* format, const Args&... args)
+{
+    return FormatArgs(outString, format, args...);
+}
+
+bool SizedPrintf(string* str, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int length = stbsp_vsnprintf(str->data, str->size, format, args);
+    va_end(args);
+
+    if (length < 0 || length >= (int)str->size) {
+        return false;
+    }
+
+    str->size = length;
+    return true;
+}
+
+// Formats into a stack buffer first, so the usual short strings take a single formatting pass.
+// Longer ones are formatted a second time, straight into their final allocation.
+template <typename Allocator>
+string AllocPrintf(Allocator* allocator, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    defer(va_end(args));
+
+    char stackBuffer[STB_SPRINTF_MIN];
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    const int length = stbsp_vsnprintf(stackBuffer, STB_SPRINTF_MIN, format, argsCopy);
+    va_end(argsCopy);
+    if (length < 0) {
+        return { .size = 0, .data = nullptr };
+    }
+
+    char* buffer = (char*)allocator->Allocate((length + 1) * sizeof(char));
+    if (buffer == nullptr) {
+        return { .size = 0, .data = nullptr };
+    }
+    if (length < STB_SPRINTF_MIN) {
+        MemCopy(buffer, stackBuffer, (length + 1) * sizeof(char));
+    }
+    else {
+        stbsp_vsnprintf(buffer, length + 1, format, args);
+    }
+
+    return { .size = (uint32)length, .data = buffer };
+}
+
+// Formats straight into the spare capacity of outString. Only when that's too small, grows it once
+// (at least doubling, like Append) and formats again.
+template <typename Allocator>
+bool AppendPrintf(DynamicArray<char, Allocator>* outString, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    defer(va_end(args));
+
+    // With no room, only measure: given a buffer and a count of 0, stb still terminates at buf[-1]
+    const uint32 spare = outString->capacity - outString->size;
+    char* dst = spare == 0 ? nullptr : outString->data + outString->size;
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    const int length = stbsp_vsnprintf(dst, spare, format, argsCopy);
+    va_end(argsCopy);
+    if (length < 0) {
+        return false;
+    }
+
+    if ((uint32)length >= spare) {
+        // +1 for the null terminator vsnprintf always writes, it stays past size
+        const uint32 minCapacity = outString->size + length + 1;
+        const uint32 doubleCapacity = outString->capacity * 2;
+        if (!outString->UpdateCapacity(doubleCapacity > minCapacity ? doubleCapacity : minCapacity)) {
+            return false;
+        }
+        stbsp_vsnprintf(outString->data + outString->size, length + 1, format, args);
+    }
+
+    outString->size += length;
+    return true;
+}
+
+template <typename T>
+bool StringToElementArray(const_string str, char sep, bool trimElements,
+                          bool (*conversionFunction)(const_string, T*),
+                          int maxElements, T* array, int* numElements)
+{
+    int elementInd = 0;
+    SplitIterator it(str, sep);
+    string next;
+    while (it.Next(&next)) {
+        if (it.done && next.size == 0 && elementInd > 0) {
+            // Nothing after the last separator
+            break;
+        }
+        if (elementInd >= maxElements) {
+            LOG_ERROR("String to array failed in %.*s (too many elements, max %d)\n",
+                      (int)str.size, str.data, maxElements);
+            return false;
+        }
+
+        string trimmed;
+        if (trimElements) {
+            trimmed = TrimWhitespace(next);
+        }
+        else {
+            trimmed = next;
+        }
+        if (!conversionFunction(trimmed, array + elementInd)) {
+            LOG_ERROR("String to array failed for %.*s in element %d conversion\n",
+                      (int)str.size, str.data, elementInd);
+            return false;
+        }
+
+        elementInd++;
+    }
+
+    *numElements = elementInd;
+    return true;
+}
+
+internal inline bool ParseNumber(const_string str, int32* number)
+{
+    return StringToIntBase10(str, number);
+}
+
+internal inline bool ParseNumber(const_string str, int64* number)
+{
+    return StringToInt64Base10(str, number);
+}
+
+internal inline bool ParseNumber(const_string str, uint32* number)
+{
+    return StringToUInt32Base10(str, number);
+}
+
+internal inline bool ParseNumber(const_string str, uint64* number)
+{
+    return StringToUInt64Base10(str, number);
+}
+
+internal inline bool ParseNumber(const_string str, float32* number)
+{
+    return StringToFloat32(str, number);
+}
+
+internal inline bool ParseNumber(const_string str, float64* number)
+{
+    return StringToFloat64(str, number);
+}
+
+template <typename T>
+bool ParseNumbers(const_string str, char separator, Array<T> numbers, uint32* numNumbers)
+{
+    SplitIterator it(str, separator);
+    string element;
+    uint32 n = 0;
+    while (it.Next(&element)) {
+        if (it.done && element.size == 0 && n > 0) {
+            break;
+        }
+        if (n == numbers.size || !ParseNumber(element, &numbers.data[n])) {
+            return false;
+        }
+        n++;
+    }
+
+    *numNumbers = n;
+    return true;
+}
+
+template <typename Allocator>
+StringInterner<Allocator>::StringInterner(Allocator* allocator)
+: blocks(allocator), atoms(allocator)
+{
+    size = 0;
+    MemSet(pages, 0, sizeof(pages));
+    block = nullptr;
+    blockUsed = 0;
+    blockCapacity = 0;
+    this->allocator = allocator;
+}
+
+template <typename Allocator>
+Atom StringInterner<Allocator>::Intern(const_string str)
+{
+    SCOPED_SPIN_LOCK(lock);
+
+    const Atom* existing = atoms.GetValue(str);
+    if (existing != nullptr) {
+        return *existing;
+    }
+
+    const uint32 index = size;
+    const uint32 pageIndex = index / STRING_INTERNER_PAGE_ATOMS;
+    if (pageIndex >= STRING_INTERNER_MAX_PAGES) {
+        LOG_ERROR("StringInterner out of atoms\n");
+        return ATOM_NONE;
+    }
+    if (pages[pageIndex] == nullptr) {
+        pages[pageIndex] = (Array<const char>*)AllocateOrUseDefaultIfNull(
+            allocator, STRING_INTERNER_PAGE_ATOMS * sizeof(Array<const char>));
+        if (pages[pageIndex] == nullptr) {
+            LOG_ERROR("StringInterner failed to allocate atom page\n");
+            return ATOM_NONE;
+        }
+    }
+
+    char* data = AllocateString(str.size + 1);
+    if (data == nullptr) {
+        LOG_ERROR("StringInterner failed to allocate %d bytes\n", str.size + 1);
+        return ATOM_NONE;
+    }
+    MemCopy(data, str.data, str.size);
+    data[str.size] = '\0';
+
+    const Array<const char> stored = { .size = str.size, .data = data };
+    pages[pageIndex][index % STRING_INTERNER_PAGE_ATOMS] = stored;
+    size++;
+
+    const Atom atom = index + 1;
+    atoms.Add(stored, atom);
+    return atom;
+}
+
+template <typename Allocator>
+Atom StringInterner<Allocator>::Find(const_string str)
+{
+    SCOPED_SPIN_LOCK(lock);
+
+    const Atom* existing = atoms.GetValue(str);
+    return existing == nullptr ? ATOM_NONE : *existing;
+}
+
+template <typename Allocator>
+const_string StringInterner<Allocator>::GetString(Atom atom) const
+{
+    // No checks against size here, other threads might be writing it
+    DEBUG_ASSERT(atom != ATOM_NONE);
+
+    const uint32 index = atom - 1;
+    const Array<const char>* page = pages[index / STRING_INTERNER_PAGE_ATOMS];
+    DEBUG_ASSERT(page != nullptr);
+    return page[index % STRING_INTERNER_PAGE_ATOMS];
+}
+
+template <typename Allocator>
+void StringInterner<Allocator>::Clear()
+{
+    for (uint32 i = blocks.size; i > 0; i--) {
+        FreeOrUseDefautIfNull(allocator, blocks[i - 1]);
+    }
+    blocks.Clear();
+    for (uint32 i = STRING_INTERNER_MAX_PAGES; i > 0; i--) {
+        if (pages[i - 1] != nullptr) {
+            FreeOrUseDefautIfNull(allocator, pages[i - 1]);
+            pages[i - 1] = nullptr;
+        }
+    }
+    atoms.Clear();
+
+    size = 0;
+    block = nullptr;
+    blockUsed = 0;
+    blockCapacity = 0;
+}
+
+template <typename Allocator>
+void StringInterner<Allocator>::Initialize(Allocator* allocator)
+{
+    blocks.Initialize(allocator);
+    atoms.Initialize(allocator);
+
+    size = 0;
+    MemSet(pages, 0, sizeof(pages));
+    block = nullptr;
+    blockUsed = 0;
+    blockCapacity = 0;
+    this->allocator = allocator;
 }
 
-void StringCat(const char* str1, const char* str2, char* dest, uint32 destMaxLength)
+template <typename Allocator>
+void StringInterner<Allocator>::Free()
 {
-    CatStrings(StringLength(str1), str1, StringLength(str2), str2, destMaxLength, dest);
+    Clear();
+    blocks.Free();
+    atoms.Free();
 }
 
-// TODO slow, naive implementation, but perfectly fine for small strings
-uint32 SubstringSearch(const_string str, const_string substr)
+template <typename Allocator>
+char* StringInterner<Allocator>::AllocateString(uint32 numBytes)
 {
-    for (uint32 i = 0; i < str.size; i++) {
-        bool match = true;
-        for (uint32 j = 0; j < substr.size; j++) {
-            uint32 ind = i + j;
-            if (ind >= str.size) {
-                match = false;
-                break;
-            }
-            if (str[i + j] != substr[j]) {
-                match = false;
-                break;
-            }
-        }
-        if (match) {
-            return i;
-        }
+    if (blockUsed + numBytes <= blockCapacity) {
+        char* result = block + blockUsed;
+        blockUsed += numBytes;
+        return result;
     }
 
-    return str.size;
+    // Big strings get their own block, so they don't waste the rest of the current one
+    const bool ownBlock = numBytes > STRING_INTERNER_BLOCK_SIZE / 4;
+    const uint32 newBlockCapacity = ownBlock ? numBytes : STRING_INTERNER_BLOCK_SIZE;
+    char* newBlock = (char*)AllocateOrUseDefaultIfNull(allocator, newBlockCapacity);
+    if (newBlock == nullptr) {
+        return nullptr;
+    }
+    blocks.Append(newBlock);
+
+    if (!ownBlock) {
+        block = newBlock;
+        blockUsed = numBytes;
+        blockCapacity = newBlockCapacity;
+    }
+    return newBlock;
 }
 
-bool StringContains(const_string str, const_string substr)
+inline char* StringBuilderChunkData(StringBuilderChunk* chunk)
 {
-    return SubstringSearch(str, substr) != str.size;
+    return (char*)(chunk + 1);
 }
 
-inline bool IsNewline(char c)
+// LinearAllocator frees roll back to the freed pointer, so free in reverse allocation order
+template <typename Allocator>
+internal void FreeStringBuilderChunks(Allocator* allocator, StringBuilderChunk* chunks)
 {
-    return c == '\n' || c == '\r';
+    StringBuilderChunk* reversed = nullptr;
+    while (chunks != nullptr) {
+        StringBuilderChunk* next = chunks->next;
+        chunks->next = reversed;
+        reversed = chunks;
+        chunks = next;
+    }
+    while (reversed != nullptr) {
+        StringBuilderChunk* next = reversed->next;
+        FreeOrUseDefautIfNull(allocator, reversed);
+        reversed = next;
+    }
 }
 
-inline bool IsWhitespace(char c)
+template <typename Allocator>
+StringBuilder<Allocator>::StringBuilder(Allocator* allocator)
 {
-    return c == ' ' || c == '\t'
-        || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    Initialize(allocator);
 }
 
-inline bool IsAlphanumeric(char c)
+template <typename Allocator>
+void StringBuilder<Allocator>::Append(char c)
 {
-    return isalnum(c) != 0;
+    char* dst = Reserve(1);
+    if (dst == nullptr) {
+        return;
+    }
+    *dst = c;
+    Commit(1);
 }
 
-string TrimWhitespace(const_string str)
+template <typename Allocator>
+void StringBuilder<Allocator>::Append(const_string str)
 {
-    uint32 start = 0;
-    while (start < str.size && IsWhitespace(str[start])) {
-        start++;
-    }
-    uint32 end = str.size;
-    while (end > 0 && IsWhitespace(str[end - 1])) {
-        end--;
+    uint32 copied = 0;
+    while (copied < str.size) {
+        const uint32 remaining = str.size - copied;
+        if (last == nullptr || last->size == last->capacity) {
+            if (!AddChunk(remaining)) {
+                return;
+            }
+        }
+
+        const uint32 available = last->capacity - last->size;
+        const uint32 n = remaining < available ? remaining : available;
+        MemCopy(StringBuilderChunkData(last) + last->size, str.data + copied, n);
+        Commit(n);
+        copied += n;
     }
+}
 
-    return string {
-        .size = end - start,
-        .data = (char*)str.data + start
-    };
+template <typename Allocator>
+void StringBuilder<Allocator>::AppendRepeated(char c, uint32 count)
+{
+    while (count > 0) {
+        if (last == nullptr || last->size == last->capacity) {
+            if (!AddChunk(count)) {
+                return;
+            }
+        }
+
+        const uint32 available = last->capacity - last->size;
+        const uint32 n = count < available ? count : available;
+        MemSet(StringBuilderChunkData(last) + last->size, (uint8)c, n);
+        Commit(n);
+        count -= n;
+    }
 }
 
-bool StringToIntBase10(const_string str, int* intBase10)
+template <typename Allocator>
+bool StringBuilder<Allocator>::AppendPrintf(const char* format, ...)
 {
-    if (str.size == 0) {
+    va_list args;
+    va_start(args, format);
+    defer(va_end(args));
+
+    // Try the room left in the last chunk first, vsnprintf needs 1 extra char for the null terminator
+    const uint32 available = last == nullptr ? 0 : last->capacity - last->size;
+    // Same as AppendPrintf on a DynamicArray, a full chunk only measures
+    char* dst = available == 0 ? nullptr : StringBuilderChunkData(last) + last->size;
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    const int length = stbsp_vsnprintf(dst, available, format, argsCopy);
+    va_end(argsCopy);
+    if (length < 0) {
         return false;
     }
 
-    bool negative = false;
-    *intBase10 = 0;
-    for (uint32 i = 0; i < str.size; i++) {
-        char c = str[i];
-        if (i == 0 && c == '-') {
-            negative = true;
-            continue;
-        }
-        if (c < '0' || c > '9') {
+    if ((uint32)length >= available) {
+        if (!AddChunk(length + 1)) {
             return false;
         }
-        *intBase10 = (*intBase10) * 10 + (int)(c - '0');
+        stbsp_vsnprintf(StringBuilderChunkData(last), length + 1, format, args);
     }
 
-    if (negative) {
-        *intBase10 = -(*intBase10);
-    }
+    Commit(length);
     return true;
 }
 
-bool StringToUInt32Base10(const_string str, uint32* intBase10)
+template <typename Allocator>
+internal bool FormatAppend(StringBuilder<Allocator>* outString, const char* data, uint32 size)
 {
-    if (str.size == 0) {
-        return false;
+    outString->Append(const_string { .size = size, .data = data });
+    return true;
+}
+
+template <typename Allocator>
+template <typename... Args>
+void StringBuilder<Allocator>::AppendFormat(const char* format, const Args&... args)
+{
+    Format(this, format, args...);
+}
+
+// True for the bytes JSON strings can't contain as-is: control characters, " and backslash
+internal inline bool JsonNeedsEscape(char c)
+{
+    return (uint8)c < 0x20 || c == '"' || c == '\\';
+}
+
+#if KM_SIMD_SSE2
+// Lanes with characters JsonNeedsEscape is true for
+internal inline __m128i SimdJsonEscapeMask(__m128i chars)
+{
+    // Unsigned c < 0x20, through a signed compare with the top bits flipped
+    const __m128i control = _mm_cmplt_epi8(_mm_xor_si128(chars, _mm_set1_epi8((char)0x80)),
+                                           _mm_set1_epi8((char)(0x20 ^ 0x80)));
+    const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')),
+                                         _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\')));
+    return _mm_or_si128(control, special);
+}
+#endif
+
+// Index of the next character to escape at or after start, or str.size. 16 at a time with SIMD.
+internal uint32 FindJsonEscape(const_string str, uint32 start)
+{
+    uint32 i = start;
+#if KM_SIMD_SSE2
+    for (; str.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(str.data + i));
+        const uint32 mask = (uint32)_mm_movemask_epi8(SimdJsonEscapeMask(chars));
+        if (mask != 0) {
+            return i + CountTrailingZeros32(mask);
+        }
     }
+#endif
 
-    *intBase10 = 0;
-    for (uint32 i = 0; i < str.size; i++) {
-        char c = str[i];
-        *intBase10 = (*intBase10) * 10 + (uint32)(c - '0');
+    while (i < str.size && !JsonNeedsEscape(str.data[i])) {
+        i++;
     }
+    return i;
+}
 
-    return true;
+// Writes the escape sequence for c (JsonNeedsEscape must be true), returns its size
+internal inline uint32 WriteJsonEscape(char c, char* dst)
+{
+    dst[0] = '\\';
+    switch (c) {
+        case '\b': dst[1] = 'b'; break;
+        case '\f': dst[1] = 'f'; break;
+        case '\n': dst[1] = 'n'; break;
+        case '\r': dst[1] = 'r'; break;
+        case '\t': dst[1] = 't'; break;
+        case '"':
+        case '\\': dst[1] = c; break;
+        default: {
+            dst[1] = 'u';
+            dst[2] = '0';
+            dst[3] = '0';
+            dst[4] = "0123456789abcdef"[(uint8)c >> 4];
+            dst[5] = "0123456789abcdef"[(uint8)c & 0xF];
+            return 6;
+        } break;
+    }
+    return 2;
 }
 
-bool StringToFloat32(const_string str, float32* f)
+uint32 JsonEscapedSize(const_string str)
 {
-    uint32 dotIndex = 0;
-    while (dotIndex < str.size && str[dotIndex] != '.') {
-        dotIndex++;
+    uint32 size = str.size;
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    const __m128i shortMin = _mm_set1_epi8('\b' - 1);
+    const __m128i shortMax = _mm_set1_epi8('\r' + 1);
+    const __m128i verticalTab = _mm_set1_epi8('\v');
+    for (; str.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(str.data + i));
+        const __m128i escape = SimdJsonEscapeMask(chars);
+        const uint32 escapeMask = (uint32)_mm_movemask_epi8(escape);
+        if (escapeMask == 0) {
+            continue;
+        }
+
+        // Escapes are 2 characters, except control characters other than \b \t \n \f \r, which are \u00XX
+        const __m128i shortControl = _mm_andnot_si128(
+            _mm_cmpeq_epi8(chars, verticalTab),
+            _mm_and_si128(_mm_cmpgt_epi8(chars, shortMin), _mm_cmplt_epi8(chars, shortMax))
+        );
+        const __m128i control = _mm_cmplt_epi8(chars, _mm_set1_epi8(0x20));
+        const __m128i longControl = _mm_andnot_si128(shortControl, _mm_and_si128(escape, control));
+        const uint32 longMask = (uint32)_mm_movemask_epi8(longControl);
+        size += PopCount32(escapeMask) + (longMask == 0 ? 0 : 4 * PopCount32(longMask));
     }
+#endif
 
-    int whole = 0;
-    float32 wholeNegative = false;
-    if (dotIndex > 0) {
-        const_string stringWhole = str.SliceTo(dotIndex);
-        if (!StringToIntBase10(stringWhole, &whole)) {
-            return false;
+    char escaped[6];
+    for (; i < str.size; i++) {
+        if (JsonNeedsEscape(str.data[i])) {
+            size += WriteJsonEscape(str.data[i], escaped) - 1;
         }
-        wholeNegative = str[0] == '-';
     }
+    return size;
+}
 
-    *f = (float32)whole;
+char* WriteJsonEscaped(const_string str, char* dst)
+{
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    // Clean blocks are stored whole, blocks with escapes are handled from the one mask
+    for (; str.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(str.data + i));
+        uint32 mask = (uint32)_mm_movemask_epi8(SimdJsonEscapeMask(chars));
+        if (mask == 0) {
+            _mm_storeu_si128((__m128i*)dst, chars);
+            dst += 16;
+            continue;
+        }
 
-    int frac = 0;
-    if (dotIndex + 1 < str.size) {
-        const_string fracString = str.SliceFrom(dotIndex + 1);
-        if (!StringToIntBase10(fracString, &frac)) {
-            return false;
+        const char* block = str.data + i;
+        uint32 runStart = 0;
+        while (mask != 0) {
+            const uint32 escapeIndex = CountTrailingZeros32(mask);
+            for (uint32 j = runStart; j < escapeIndex; j++) {
+                *dst++ = block[j];
+            }
+            dst += WriteJsonEscape(block[escapeIndex], dst);
+            runStart = escapeIndex + 1;
+            mask &= mask - 1;
+        }
+        for (uint32 j = runStart; j < 16; j++) {
+            *dst++ = block[j];
         }
+    }
+#endif
 
-        frac = wholeNegative ? -frac : frac;
-        float32 fractional = (float32)frac;
-        for (uint32 i = 0; i < fracString.size; i++) {
-            fractional /= 10.0f;
+    for (; i < str.size; i++) {
+        const char c = str.data[i];
+        if (JsonNeedsEscape(c)) {
+            dst += WriteJsonEscape(c, dst);
+        }
+        else {
+            *dst++ = c;
         }
-        *f += fractional;
     }
-    return true;
+    return dst;
 }
 
 template <typename Allocator>
-void StringSplit(const_string str, char c, DynamicArray<string, Allocator>* outSplit)
+void StringBuilder<Allocator>::AppendEscapedJson(const_string str)
 {
-    outSplit->Clear();
-
-    string s = ToNonConstString(str);
+    uint32 i = 0;
     while (true) {
-        uint32 next = s.FindFirst(c);
-        if (next == s.size) {
-            outSplit->Append(s);
+        const uint32 runEnd = FindJsonEscape(str, i);
+        Append(str.Slice(i, runEnd));
+        if (runEnd == str.size) {
             break;
         }
-        uint32 newSize = s.size - next - 1;
-        s.size = next;
-        outSplit->Append(s);
 
-        s.data += next + 1;
-        s.size = newSize;
+        char escaped[6];
+        const uint32 escapedSize = WriteJsonEscape(str.data[runEnd], escaped);
+        Append(const_string { .size = escapedSize, .data = escaped });
+        i = runEnd + 1;
     }
 }
 
-string NextSplitElement(string* str, char separator)
+template <typename Allocator>
+void StringBuilder<Allocator>::Indent(uint32 spaces)
 {
-    string next = *str;
-    for (uint32 i = 0; i < str->size; i++) {
-        if ((*str)[i] == separator) {
-            next.size = i;
-            str->size--;
-            break;
-        }
-    }
+    indent += spaces;
+}
 
-    str->size -= next.size;
-    str->data += next.size + 1;
-    return next;
+template <typename Allocator>
+void StringBuilder<Allocator>::Unindent(uint32 spaces)
+{
+    DEBUG_ASSERT(indent >= spaces);
+    indent -= spaces;
 }
 
 template <typename Allocator>
-string StringConcatenate(const_string str1, const_string str2, Allocator* allocator)
+void StringBuilder<Allocator>::AppendIndent()
 {
-    string result;
-    result.size = str1.size + str2.size;
-    result.data = allocator->New<char>(result.size);
-    if (result.data == nullptr) {
-        return string::empty;
-    }
-    MemCopy(result.data, str1.data, str1.size);
-    MemCopy(result.data + str1.size, str2.data, str2.size);
-    return result;
+    AppendRepeated(' ', indent);
 }
 
-bool SizedPrintf(string* str, const char* format, ...)
+template <typename Allocator>
+void StringBuilder<Allocator>::AppendLine(const_string str)
 {
-    va_list args;
-    va_start(args, format);
-    const int length = stbsp_vsnprintf(str->data, str->size, format, args);
-    va_end(args);
+    AppendIndent();
+    Append(str);
+    Append('\n');
+}
 
-    if (length < 0 || length >= (int)str->size) {
-        return false;
+template <typename Allocator>
+char* StringBuilder<Allocator>::Reserve(uint32 numChars)
+{
+    if (last == nullptr || last->capacity - last->size < numChars) {
+        if (!AddChunk(numChars)) {
+            return nullptr;
+        }
     }
 
-    str->size = length;
-    return true;
+    return StringBuilderChunkData(last) + last->size;
 }
 
 template <typename Allocator>
-string AllocPrintf(Allocator* allocator, const char* format, ...)
+void StringBuilder<Allocator>::Commit(uint32 numChars)
 {
-    int bufferSize = 256;
-    while (true) {
-        char* buffer = (char*)allocator->Allocate(bufferSize * sizeof(char));
-        va_list args;
-        va_start(args, format);
-        int length = stbsp_vsnprintf(buffer, bufferSize, format, args);
-        va_end(args);
-        if (length < 0) {
+    DEBUG_ASSERT(last != nullptr && last->size + numChars <= last->capacity);
+    last->size += numChars;
+    size += numChars;
+}
+
+template <typename Allocator>
+string StringBuilder<Allocator>::ToString()
+{
+    if (first == nullptr) {
+        return { .size = 0, .data = nullptr };
+    }
+    if (first != last) {
+        DEBUG_ASSERT(size <= UINT32_MAX_VALUE);
+        StringBuilderChunk* oldFirst = first;
+        StringBuilderChunk* oldLast = last;
+        first = nullptr;
+        last = nullptr;
+        // At least size (AddChunk's usual minimum applies), later appends fill any room left.
+        // Merging doesn't count as growth, so the chunk size schedule is restored after.
+        const uint32 savedNextChunkCapacity = nextChunkCapacity;
+        if (!AddChunk((uint32)size)) {
+            first = oldFirst;
+            last = oldLast;
             return { .size = 0, .data = nullptr };
         }
-        else if (length < bufferSize) {
-            return { .size = (uint32)length, .data = buffer };
+        nextChunkCapacity = savedNextChunkCapacity;
+
+        char* merged = StringBuilderChunkData(first);
+        for (StringBuilderChunk* chunk = oldFirst; chunk != nullptr; chunk = chunk->next) {
+            MemCopy(merged + first->size, StringBuilderChunkData(chunk), chunk->size);
+            first->size += chunk->size;
+        }
+
+        // Retired chunks stay in allocation order
+        if (retired == nullptr) {
+            retired = oldFirst;
         }
         else {
-            bufferSize *= 2;
+            StringBuilderChunk* retiredLast = retired;
+            while (retiredLast->next != nullptr) {
+                retiredLast = retiredLast->next;
+            }
+            retiredLast->next = oldFirst;
         }
     }
+
+    return { .size = first->size, .data = StringBuilderChunkData(first) };
 }
 
 template <typename Allocator>
-char* AllocPrintfDynamicArrayCallback(const char* buffer, void* user, int length)
+void StringBuilder<Allocator>::Clear()
 {
-    DynamicArray<char, Allocator>* result = *((DynamicArray<char, Allocator>*)user);
-    result->Append(string { .size = length, .data = buffer });
-    return buffer;
+    FreeStringBuilderChunks(allocator, first);
+    FreeStringBuilderChunks(allocator, retired);
+
+    size = 0;
+    first = nullptr;
+    last = nullptr;
+    retired = nullptr;
+    nextChunkCapacity = STRING_BUILDER_START_CHUNK_SIZE;
+    indent = 0;
 }
 
 template <typename Allocator>
-DynamicArray<char, Allocator> AllocPrintf(const char* format, ...)
+void StringBuilder<Allocator>::Initialize(Allocator* allocator)
 {
-    DynamicArray<char, Allocator> result;
+    size = 0;
+    first = nullptr;
+    last = nullptr;
+    retired = nullptr;
+    nextChunkCapacity = STRING_BUILDER_START_CHUNK_SIZE;
+    indent = 0;
+    this->allocator = allocator;
+}
 
-    char buffer[STB_SPRINTF_MIN];
-    va_list args;
-    va_start(args, format);
-    int length = stbsp_vsprintfcb(AllocPrintfDynamicArrayCallback<Allocator>,
-                                  &result, buffer, format, args);
-    va_end(args);
+template <typename Allocator>
+void StringBuilder<Allocator>::Free()
+{
+    Clear();
+}
 
-    if (length < 0) {
-        result.Clear();
+template <typename Allocator>
+bool StringBuilder<Allocator>::AddChunk(uint32 minCapacity)
+{
+    const uint32 capacity = minCapacity > nextChunkCapacity ? minCapacity : nextChunkCapacity;
+    StringBuilderChunk* chunk = (StringBuilderChunk*)AllocateOrUseDefaultIfNull(
+        allocator, sizeof(StringBuilderChunk) + capacity);
+    if (chunk == nullptr) {
+        LOG_ERROR("StringBuilder failed to allocate %d bytes\n", capacity);
+        return false;
+    }
+
+    chunk->next = nullptr;
+    chunk->size = 0;
+    chunk->capacity = capacity;
+    if (last == nullptr) {
+        first = chunk;
     }
-    else if (length != result.size) {
-        result.Clear();
+    else {
+        last->next = chunk;
     }
+    last = chunk;
 
-    return result;
+    if (nextChunkCapacity < STRING_BUILDER_MAX_CHUNK_SIZE) {
+        nextChunkCapacity *= 2;
+    }
+    return true;
 }
 
-template <typename T>
-bool StringToElementArray(const_string str, char sep, bool trimElements,
-                          bool (*conversionFunction)(const_string, T*),
-                          int maxElements, T* array, int* numElements)
+// Number of leading ASCII bytes
+internal uint32 Utf8AsciiPrefix(const char* data, uint32 size)
 {
-    int elementInd = 0;
-    string s = ToNonConstString(str);
-    while (true) {
-        string next = NextSplitElement(&s, sep);
-        string trimmed;
-        if (trimElements) {
-            trimmed = TrimWhitespace(next);
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    for (; size - i >= 16; i += 16) {
+        const uint32 mask = (uint32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + i)));
+        if (mask != 0) {
+            return i + CountTrailingZeros32(mask);
         }
-        else {
-            trimmed = next;
+    }
+#endif
+
+    while (i < size && (uint8)data[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Decodes the (non-ASCII) code point at the start of data. Returns its byte length, 0 if invalid.
+internal uint32 Utf8DecodeMultiByte(const uint8* data, uint32 size, uint32* codePoint)
+{
+    const uint8 lead = data[0];
+    uint32 length, minCodePoint;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        minCodePoint = 0x80;
+        *codePoint = lead & 0x1F;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        minCodePoint = 0x800;
+        *codePoint = lead & 0x0F;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        minCodePoint = 0x10000;
+        *codePoint = lead & 0x07;
+    }
+    else {
+        // Continuation byte, overlong 2-byte lead (0xC0, 0xC1) or past U+10FFFF
+        return 0;
+    }
+
+    if (size < length) {
+        return 0;
+    }
+    for (uint32 i = 1; i < length; i++) {
+        if ((data[i] & 0xC0) != 0x80) {
+            return 0;
         }
-        if (!conversionFunction(trimmed, array + elementInd)) {
-            LOG_ERROR("String to array failed for %.*s in element %d conversion\n",
-                      (int)str.size, str.data, elementInd);
+        *codePoint = (*codePoint << 6) | (data[i] & 0x3F);
+    }
+
+    if (*codePoint < minCodePoint || *codePoint > 0x10FFFF || (*codePoint >= 0xD800 && *codePoint <= 0xDFFF)) {
+        return 0;
+    }
+    return length;
+}
+
+bool Utf8IsValid(const_string utf8String)
+{
+    const uint8* data = (const uint8*)utf8String.data;
+    uint32 i = 0;
+    while (true) {
+        i += Utf8AsciiPrefix(utf8String.data + i, utf8String.size - i);
+        if (i == utf8String.size) {
+            return true;
+        }
+
+        uint32 codePoint;
+        const uint32 length = Utf8DecodeMultiByte(data + i, utf8String.size - i, &codePoint);
+        if (length == 0) {
             return false;
         }
+        i += length;
+    }
+}
 
-        if (s.size == 0) {
-            break;
+uint32 Utf8CodePointCount(const_string utf8String)
+{
+    // Every byte except continuation bytes (10xxxxxx) starts a code point
+    uint32 count = 0;
+    uint32 i = 0;
+#if KM_SIMD_SSE2
+    // Continuation bytes are exactly the signed bytes < -64
+    const __m128i continuationLimit = _mm_set1_epi8((char)0xC0);
+    for (; utf8String.size - i >= 16; i += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i*)(utf8String.data + i));
+        const uint32 continuationMask = (uint32)_mm_movemask_epi8(_mm_cmplt_epi8(chars, continuationLimit));
+        count += 16 - PopCount32(continuationMask);
+    }
+#endif
+
+    for (; i < utf8String.size; i++) {
+        count += ((uint8)utf8String.data[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+bool Utf8ToUtf32(const_string utf8String, uint32 maxCodePoints, uint32* codePoints, uint32* numCodePoints)
+{
+    const uint8* data = (const uint8*)utf8String.data;
+    uint32 n = 0;
+    uint32 i = 0;
+    while (i < utf8String.size) {
+        if (data[i] >= 0x80) {
+            if (n == maxCodePoints) {
+                return false;
+            }
+            const uint32 length = Utf8DecodeMultiByte(data + i, utf8String.size - i, &codePoints[n]);
+            if (length == 0) {
+                return false;
+            }
+            n++;
+            i += length;
+            continue;
         }
-        elementInd++;
-        if (elementInd >= maxElements) {
-            LOG_ERROR("String to array failed in %.*s (too many elements, max %d)\n",
-                      (int)str.size, str.data, maxElements);
+
+        // ASCII run, zero-extended 16 bytes at a time
+        const uint32 asciiEnd = i + Utf8AsciiPrefix(utf8String.data + i, utf8String.size - i);
+        if (asciiEnd - i > maxCodePoints - n) {
             return false;
         }
+#if KM_SIMD_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; asciiEnd - i >= 16; i += 16, n += 16) {
+            const __m128i chars = _mm_loadu_si128((const __m128i*)(data + i));
+            const __m128i lo16 = _mm_unpacklo_epi8(chars, zero);
+            const __m128i hi16 = _mm_unpackhi_epi8(chars, zero);
+            __m128i* dst = (__m128i*)(codePoints + n);
+            _mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(lo16, zero));
+            _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo16, zero));
+            _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi16, zero));
+            _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi16, zero));
+        }
+#endif
+        for (; i < asciiEnd; i++) {
+            codePoints[n++] = data[i];
+        }
     }
 
-    *numElements = elementInd + 1;
+    *numCodePoints = n;
     return true;
 }
 
 #ifdef KM_UTF8
-template <typename Allocator>
-bool Utf8ToUppercase(const_string utf8String, DynamicArray<char, Allocator>* outString)
+template <bool UPPERCASE, typename Allocator>
+internal bool Utf8ChangeCase(const_string utf8String, DynamicArray<char, Allocator>* outString)
 {
-    FixedArray<char, 4> utf8Buffer;
-    uint64 i = 0;
+    // Case mapping rarely changes byte lengths, so one allocation usually covers everything
+    if (outString->capacity - outString->size < utf8String.size) {
+        if (!outString->UpdateCapacity(outString->size + utf8String.size)) {
+            return false;
+        }
+    }
+
+    const char caseFirst = UPPERCASE ? 'a' : 'A';
+    const char caseLast = UPPERCASE ? 'z' : 'Z';
+    uint32 i = 0;
     while (i < utf8String.size) {
+        // ASCII bytes are all non-negative as int8, so signed compares work for the range check
+        const uint32 asciiEnd = i + Utf8AsciiPrefix(utf8String.data + i, utf8String.size - i);
+        if (outString->capacity - outString->size < asciiEnd - i) {
+            const uint32 doubleCapacity = outString->capacity * 2;
+            const uint32 minCapacity = outString->size + (asciiEnd - i);
+            if (!outString->UpdateCapacity(doubleCapacity > minCapacity ? doubleCapacity : minCapacity)) {
+                return false;
+            }
+        }
+        char* dst = outString->data + outString->size;
+        outString->size += asciiEnd - i;
+#if KM_SIMD_SSE2
+        const __m128i rangeMin = _mm_set1_epi8(caseFirst - 1);
+        const __m128i rangeMax = _mm_set1_epi8(caseLast + 1);
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        for (; asciiEnd - i >= 16; i += 16, dst += 16) {
+            const __m128i chars = _mm_loadu_si128((const __m128i*)(utf8String.data + i));
+            const __m128i inRange = _mm_and_si128(_mm_cmpgt_epi8(chars, rangeMin), _mm_cmplt_epi8(chars, rangeMax));
+            _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(chars, _mm_and_si128(inRange, caseBit)));
+        }
+#endif
+        for (; i < asciiEnd; i++, dst++) {
+            const char c = utf8String.data[i];
+            *dst = c >= caseFirst && c <= caseLast ? c ^ 0x20 : c;
+        }
+        if (i == utf8String.size) {
+            break;
+        }
+
+        // Non-ASCII code point, through utf8proc
         int32 codePoint;
         utf8proc_ssize_t codePointBytes = utf8proc_iterate((uint8*)&utf8String[i],
                                                            utf8String.size - i, &codePoint);
@@ -435,19 +2752,35 @@ bool Utf8ToUppercase(const_string utf8String, DynamicArray<char, Allocator>* out
             LOG_ERROR("Invalid UTF-8 bytes\n");
             return false;
         }
-        i += codePointBytes;
+        i += (uint32)codePointBytes;
 
-        int32 codePointUpper = utf8proc_toupper(codePoint);
-        utf8proc_ssize_t codePointUpperBytes = utf8proc_encode_char(codePointUpper,
-                                                                    (uint8*)utf8Buffer.data);
-        if (codePointUpperBytes == 0) {
-            LOG_ERROR("Failed to write UTF-8 codePointUpper\n");
+        const int32 codePointMapped = UPPERCASE ? utf8proc_toupper(codePoint) : utf8proc_tolower(codePoint);
+        if (outString->capacity - outString->size < 4) {
+            if (!outString->UpdateCapacity(outString->capacity * 2 + 4)) {
+                return false;
+            }
+        }
+        utf8proc_ssize_t codePointMappedBytes = utf8proc_encode_char(codePointMapped,
+                                                                     (uint8*)outString->data + outString->size);
+        if (codePointMappedBytes == 0) {
+            LOG_ERROR("Failed to write UTF-8 codePointMapped\n");
             return false;
         }
-        utf8Buffer.size = codePointUpperBytes;
-        outString->Append(utf8Buffer.ToArray());
+        outString->size += (uint32)codePointMappedBytes;
     }
 
     return true;
 }
+
+template <typename Allocator>
+bool Utf8ToUppercase(const_string utf8String, DynamicArray<char, Allocator>* outString)
+{
+    return Utf8ChangeCase<true>(utf8String, outString);
+}
+
+template <typename Allocator>
+bool Utf8ToLowercase(const_string utf8String, DynamicArray<char, Allocator>* outString)
+{
+    return Utf8ChangeCase<false>(utf8String, outString);
+}
 #endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "km_array.h"
+#include "km_atomic.h"
 #include "km_container.h"
 
 using string = Array<char>;
@@ -22,21 +23,75 @@ char* ToCString(const_string str, Allocator* allocator);
 
 int StringCompare(const_string str1, const_string str2);
 bool StringEquals(const_string str1, const_string str2);
+// ASCII case-insensitive, other bytes must match exactly
+bool StringEqualsIgnoreCase(const_string str1, const_string str2);
+// Same as KeyHash on the ASCII-lowercased string
+uint32 StringHashIgnoreCase(const_string str);
 
-uint32 SubstringSearch(const_string str, const_string substr);
+// Index of the first match at or after start, or str.size if there is none
+uint32 SubstringSearch(const_string str, const_string substr, uint32 start = 0);
+// Index of the last match, or str.size if there is none
+uint32 SubstringSearchLast(const_string str, const_string substr);
+// Indices of all non-overlapping matches, left to right
+template <typename Allocator>
+void SubstringSearchAll(const_string str, const_string substr, DynamicArray<uint32, Allocator>* outIndices);
 bool StringContains(const_string str, const_string substr);
 
 bool IsNewline(char c);
 bool IsWhitespace(char c);
 bool IsAlphanumeric(char c);
 
+char ToLowercaseAscii(char c);
+char ToUppercaseAscii(char c);
+
+// Index of the first (non-)whitespace char at or after start, str.size if there is none
+uint32 SkipWhitespace(const_string str, uint32 start = 0);
+uint32 FindWhitespace(const_string str, uint32 start = 0);
 string TrimWhitespace(const_string str);
 
+// Validated and overflow-checked, the whole string has to be the number.
+// Signed versions take an optional leading '-' or '+', base 16 versions an optional 0x or 0X prefix.
 bool StringToIntBase10(const_string str, int* intBase10);
+bool StringToInt64Base10(const_string str, int64* intBase10);
 bool StringToUInt32Base10(const_string str, uint32* intBase10);
+bool StringToUInt64Base10(const_string str, uint64* intBase10);
+bool StringToUInt32Base16(const_string str, uint32* intBase16);
+bool StringToUInt64Base16(const_string str, uint64* intBase16);
+// Correctly rounded. Accepts [+-]digits[.digits][(e|E)[+-]digits] (digits on at least one side of
+// the '.'), and inf, infinity, nan in any case. The whole string has to be the number.
 bool StringToFloat32(const_string str, float32* f);
+bool StringToFloat64(const_string str, float64* f);
 
 string NextSplitElement(string* str, char separator);
+
+// Yields the elements between separators as slices of the original string, no copies.
+// Separators are found 64 bytes at a time (a bitmask per block), so short elements are cheap.
+// "a,,b" yields "a", "", "b"; "" yields a single empty element, like NextSplitElement.
+struct SplitIterator
+{
+    const char* data;
+    uint32 size;
+    uint32 elementStart;
+    uint32 blockStart;
+    uint64 separatorMask; // separators in the block at blockStart not yet yielded
+    char separator;
+    bool done;
+
+    SplitIterator(const_string str, char separator);
+
+    bool Next(string* outElement);
+};
+
+// Lines without their "\n" or "\r\n". A trailing newline doesn't produce an extra empty line.
+struct LineIterator
+{
+    SplitIterator split;
+
+    LineIterator(const_string str);
+
+    bool Next(string* outLine);
+};
+
 template <typename Allocator>
 void StringSplit(const_string str, char c, DynamicArray<string, Allocator>* outSplit);
 
@@ -44,17 +99,180 @@ template <typename T>
 bool StringToElementArray(const_string str, char sep, bool trimElements,
                           bool (*conversionFunction)(const_string, T*),
                           int maxElements, T* array, int* numElements);
+// Same as StringToElementArray without trimming, for T in int32, int64, uint32, uint64, float32 and
+// float64. Converts while it tokenizes, with direct (inlinable) calls instead of a function pointer.
+// numbers is the output buffer, fails if there are more than numbers.size elements.
+// A trailing separator is ignored, as in StringToElementArray.
+template <typename T>
+bool ParseNumbers(const_string str, char separator, Array<T> numbers, uint32* numNumbers);
 
 template <typename Allocator>
 string StringConcatenate(const_string str1, const_string str2, Allocator* allocator);
 
+// Direct number formatting, no format string parsing. Floats are printed with the fewest digits
+// that parse back to the same value, in plain notation for exponents in (-7, 21), scientific otherwise.
+static const uint32 FORMAT_INT_MAX_LENGTH = 20;
+static const uint32 FORMAT_HEX_MAX_LENGTH = 16;
+static const uint32 FORMAT_FLOAT_MAX_LENGTH = 32;
+
+// Writes to buffer, which needs room for FORMAT_XXX_MAX_LENGTH chars, and returns the length
+uint32 FormatInt(int64 value, char* buffer);
+uint32 FormatUInt(uint64 value, char* buffer);
+uint32 FormatHex(uint64 value, char* buffer, uint32 minDigits = 1); // lowercase, no prefix
+uint32 FormatFloat(float32 value, char* buffer);
+uint32 FormatFloat(float64 value, char* buffer);
+
+// Appends to outString, a FixedArray<char, S> or DynamicArray<char, Allocator>.
+// Returns false if a FixedArray runs out of room, in which case it is left as it was.
+template <typename CharArray>
+bool FormatInt(int64 value, CharArray* outString);
+template <typename CharArray>
+bool FormatUInt(uint64 value, CharArray* outString);
+template <typename CharArray>
+bool FormatHex(uint64 value, CharArray* outString, uint32 minDigits = 1);
+template <typename CharArray>
+bool FormatFloat(float32 value, CharArray* outString);
+template <typename CharArray>
+bool FormatFloat(float64 value, CharArray* outString);
+
+// Type-safe formatting: each {} in format is replaced by the next argument, {{ and }} are braces.
+// Arguments can be integers, floats, char, bool, C strings, string/const_string, and char Dynamic/FixedArrays.
+// Appends to outString like the functions above. With a FixedArray, stops at the first piece that doesn't fit.
+template <typename CharArray, typename... Args>
+bool Format(CharArray* outString, const char* format, const Args&... args);
+
 bool SizedPrintf(string* str, const char* format, ...);
+// One allocation of exactly the formatted size (+1, the result is null-terminated)
 template <typename Allocator>
 string AllocPrintf(Allocator* allocator, const char* format, ...);
+// Appends to outString, growing it at most once
 template <typename Allocator>
-DynamicArray<char, Allocator> AllocPrintf(const char* format, ...);
+bool AppendPrintf(DynamicArray<char, Allocator>* outString, const char* format, ...);
+
+// Handle to a string in a StringInterner. Atoms from the same interner are equal iff the strings are.
+using Atom = uint32;
+const Atom ATOM_NONE = 0;
+
+static const uint32 STRING_INTERNER_BLOCK_SIZE = KILOBYTES(16);
+static const uint32 STRING_INTERNER_PAGE_ATOMS = 4096;
+static const uint32 STRING_INTERNER_MAX_PAGES = 1024;
+
+// Maps strings to Atoms, so strings seen over and over (keywords, asset names...) are stored once and
+// then compared and hashed as a uint32 (use Atom as a HashTable key).
+// Interned strings are null-terminated and stay valid until Clear or Free.
+// Intern and Find are thread-safe. GetString doesn't lock, and is safe for any atom obtained from
+// Intern or Find, since those go through the lock.
+template <typename Allocator = StandardAllocator>
+struct StringInterner
+{
+    uint32 size;
+    // Atom -> string, in fixed pages so growing never moves entries other threads might be reading
+    Array<const char>* pages[STRING_INTERNER_MAX_PAGES];
+    char* block;
+    uint32 blockUsed;
+    uint32 blockCapacity;
+    DynamicArray<char*, Allocator> blocks;
+    HashTable<Atom, Allocator, Array<const char>> atoms;
+    SpinLock lock;
+    Allocator* allocator;
+
+    StringInterner(Allocator* allocator = nullptr);
+    StringInterner(const StringInterner<Allocator>& other) = delete;
+
+    // Returns ATOM_NONE only if out of memory or atoms
+    Atom Intern(const_string str);
+    // Returns ATOM_NONE if str was never interned
+    Atom Find(const_string str);
+    const_string GetString(Atom atom) const;
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr);
+    void Free();
+
+    private:
+    char* AllocateString(uint32 numBytes);
+};
+
+static const uint32 STRING_BUILDER_START_CHUNK_SIZE = KILOBYTES(4);
+static const uint32 STRING_BUILDER_MAX_CHUNK_SIZE = MEGABYTES(1);
+
+struct StringBuilderChunk
+{
+    StringBuilderChunk* next;
+    uint32 size;
+    uint32 capacity;
+    // capacity chars follow
+};
+
+// Appends into a list of chunks that never move, so growing never copies what was already written.
+// Chunks grow from STRING_BUILDER_START_CHUNK_SIZE up to STRING_BUILDER_MAX_CHUNK_SIZE.
+// The result is either made contiguous with ToString (at most one copy), or written to a file
+// chunk by chunk (see WriteFile in km_os.h).
+template <typename Allocator = StandardAllocator>
+struct StringBuilder
+{
+    uint64 size;
+    StringBuilderChunk* first;
+    StringBuilderChunk* last;
+    // Chunks merged by ToString, kept until Clear/Free so LinearAllocator frees stay in order
+    StringBuilderChunk* retired;
+    uint32 nextChunkCapacity;
+    uint32 indent; // in spaces, see Indent and AppendIndent
+    Allocator* allocator;
+
+    StringBuilder(Allocator* allocator = nullptr);
+    StringBuilder(const StringBuilder<Allocator>& other) = delete;
+
+    void Append(char c);
+    void Append(const_string str);
+    void AppendRepeated(char c, uint32 count);
+    bool AppendPrintf(const char* format, ...);
+    // Type-safe, same rules as Format
+    template <typename... Args>
+    void AppendFormat(const char* format, const Args&... args);
+    // Escapes quotes, backslashes and control characters. Doesn't add the surrounding quotes.
+    void AppendEscapedJson(const_string str);
+
+    void Indent(uint32 spaces = 4);
+    void Unindent(uint32 spaces = 4);
+    void AppendIndent();
+    // Indent, str, newline
+    void AppendLine(const_string str);
+
+    // Contiguous room for numChars at the end, to write into directly and then Commit
+    char* Reserve(uint32 numChars);
+    void Commit(uint32 numChars);
+
+    // Zero-copy if everything fits in one chunk, otherwise merges all chunks into one.
+    // Valid until the next append, Clear or Free.
+    string ToString();
+
+    void Clear();
+    void Initialize(Allocator* allocator = nullptr);
+    void Free();
+
+    private:
+    bool AddChunk(uint32 minCapacity);
+};
+
+// JSON string escaping, without the surrounding quotes. Clean runs are found with SIMD and copied in bulk.
+uint32 JsonEscapedSize(const_string str);
+// dst needs JsonEscapedSize(str) bytes, returns the end of what was written
+char* WriteJsonEscaped(const_string str, char* dst);
+
+// Strict UTF-8 (RFC 3629): no overlong encodings, surrogates or code points past U+10FFFF.
+// ASCII runs are skipped 16 bytes at a time.
+bool Utf8IsValid(const_string utf8String);
+// Number of code points, assuming valid UTF-8
+uint32 Utf8CodePointCount(const_string utf8String);
+// Decodes into a caller-provided buffer, Utf8CodePointCount gives the size it needs.
+// Fails on invalid UTF-8 or more than maxCodePoints code points.
+bool Utf8ToUtf32(const_string utf8String, uint32 maxCodePoints, uint32* codePoints, uint32* numCodePoints);
 
 #ifdef KM_UTF8
+// Appends to outString. ASCII is mapped 16 bytes at a time, utf8proc only handles the rest.
 template <typename Allocator>
 bool Utf8ToUppercase(const_string utf8String, DynamicArray<char, Allocator>* outString);
+template <typename Allocator>
+bool Utf8ToLowercase(const_string utf8String, DynamicArray<char, Allocator>* outString);
 #endif